@@ -21,6 +21,7 @@ typedef enum
 {
 	MEMPERM_READ     = 1,          ///< Readable
 	MEMPERM_WRITE    = 2,          ///< Writable
+	MEMPERM_READWRITE = MEMPERM_READ | MEMPERM_WRITE, ///< Readable and writable
 } MemPerm;
 
 typedef enum
@@ -54,6 +55,7 @@ void   svcBreak(UserBreakType breakReason);
 void   svcSleepThread(u64 nanoseconds);
 Result svcCreateAddressArbiter(Handle *arbiter);
 Result svcArbitrateAddressNoTimeout(Handle arbiter, u32 addr, ArbitrationType type, s32 value);
+Result svcCreateMemoryBlock(Handle *memblock, u32 addr, u32 size, MemPerm my_perm, MemPerm other_perm);
 Result svcCreateEvent(Handle* event, ResetType reset_type);
 Result svcSignalEvent(Handle handle);
 s64 svcGetSystemTick(void);
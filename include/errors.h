@@ -15,10 +15,20 @@
 // general mcu
 #define MCU_INTERNAL_RANGE               MAKERESULT(RL_FATAL, RS_INTERNAL  , RM_MCU, RD_OUT_OF_RANGE)
 #define MCU_INVALID_SIZE                 MAKERESULT(RL_USAGE, RS_INVALIDARG, RM_MCU, RD_INVALID_SIZE)
+#define MCU_OUT_OF_RANGE                 MAKERESULT(RL_USAGE, RS_INVALIDARG, RM_MCU, RD_OUT_OF_RANGE)
+#define MCU_INVALID_TOKEN                MAKERESULT(RL_USAGE, RS_INVALIDARG, RM_MCU, RD_INVALID_HANDLE)
+
+// step count subscriptions
+#define MCU_OUT_OF_SUBSCRIPTIONS         MAKERESULT(RL_TEMPORARY, RS_OUTOFRESOURCE, RM_MCU, RD_OUT_OF_MEMORY)
+
+// exclusive interrupt mode
+#define MCU_EXCLUSIVE_IRQ_BUSY           MAKERESULT(RL_TEMPORARY, RS_INVALIDSTATE, RM_MCU, RD_BUSY)
+#define MCU_LCD_ACK_TIMEOUT              MAKERESULT(RL_TEMPORARY, RS_CANCELED, RM_MCU, RD_TIMEOUT)
 
 // general os
 
 #define OS_MISALIGNED_ADDRESS            MAKERESULT(RL_USAGE, RS_INVALIDARG, RM_OS, RD_MISALIGNED_ADDRESS)
+#define OS_TIMEOUT                       MAKERESULT(RL_INFO , RS_STATUSCHANGED, RM_OS, RD_TIMEOUT) // 09401BFE
 
 // ACCelerometer
 
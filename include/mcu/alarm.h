@@ -0,0 +1,26 @@
+#ifndef _MCU_ALARM_H
+#define _MCU_ALARM_H
+
+#include <3ds/types.h>
+#include <mcu/mcu.h>
+
+#define RTC_ALARM_COUNT       16
+#define RTC_ALARM_OWNER_COUNT 8
+
+/* owner of the alarm set through the original RTC alarm commands, it has no event of its own */
+#define RTC_ALARM_LEGACY_OWNER ((void *)1)
+/* owner of the coarse alarms behind long wake timers, see timer.c */
+#define RTC_ALARM_TIMER_OWNER  ((void *)2)
+
+Result mcuAddRtcAlarm(void *owner, const MCU_RtcAlarm *alarm, u32 *out_id, Handle *out_event);
+Result mcuAddInternalRtcAlarm(void *owner, u32 minute_key, u32 *out_id);
+Result mcuCancelRtcAlarm(void *owner, u32 id);
+void mcuReleaseRtcAlarms(void *owner);
+bool mcuFireRtcAlarms();
+
+Result mcuSetLegacyRtcAlarm(const MCU_RtcAlarm *alarm);
+void mcuGetLegacyRtcAlarm(MCU_RtcAlarm *out_alarm);
+Result mcuSetLegacyRtcAlarmField(u8 field_regid, u8 value);
+u8 mcuGetLegacyRtcAlarmField(u8 field_regid);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef _MCU_BATTERY_H
+#define _MCU_BATTERY_H
+
+#include <3ds/types.h>
+
+#define BATTERY_HISTORY_COUNT 64 /* must be a power of two */
+
+/* adaptive sampling interval bounds, in milliseconds */
+#define BATTERY_SAMPLE_MIN_MS 2000
+#define BATTERY_SAMPLE_MAX_MS 60000
+
+/* the battery event only fires when the PCB temperature crosses into another band of this width */
+#define BATTERY_TEMPERATURE_BAND 5
+
+/*
+	One sample of MCUREG_BATTERY_PCB_TEMPERATURE..MCUREG_BATTERY_VOLTAGE, read in a
+	single transaction. The percentage keeps the (otherwise unused) fractional
+	register as the low byte.
+*/
+typedef struct MCU_BatterySample {
+	u32 seconds;     /* since boot */
+	u16 percentage;  /* 8.8 fixed point */
+	u8 voltage;      /* 20mV units */
+	u8 temperature;  /* degrees celsius */
+} MCU_BatterySample;
+
+/* the estimator only takes a new rate once this much time has passed since the last one */
+#define BATTERY_ESTIMATE_MIN_SPAN_S 60
+#define BATTERY_ESTIMATE_UNKNOWN    0xFFFFFFFF
+
+typedef struct MCU_BatteryEstimate {
+	u32 minutes;     /* to empty while discharging, to full while charging, BATTERY_ESTIMATE_UNKNOWN if there is no trend yet */
+	s32 rate;        /* 1/65536 percent per minute, positive while charging */
+	u8 confidence;   /* 0-100 */
+	bool charging;
+	u8 reserved[2];
+} MCU_BatteryEstimate;
+
+Result mcuSampleBattery(bool lock);
+void mcuGetBatterySample(MCU_BatterySample *out_sample);
+u32 mcuGetBatteryHistory(MCU_BatterySample *out_samples, u32 max_samples, u32 *out_total);
+void mcuGetBatteryEstimate(MCU_BatteryEstimate *out_estimate);
+void mcuRequestBatterySample();
+s64 mcuRunBatterySampler(s64 now);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef _MCU_COALESCE_H
+#define _MCU_COALESCE_H
+
+#include <3ds/types.h>
+
+/* no register is held longer than this, no matter what window a client asks for */
+#define COALESCE_WINDOW_MAX_MS 1000
+
+Result mcuSetLedStateCoalesced(u8 led_regid, u8 state);
+Result mcuGetLedStateCoalesced(u8 led_regid, u8 *out_state);
+Result mcuSetCoalesceWindow(u8 led_regid, u32 window_ms);
+Result mcuFlushCoalescedWrite(u8 led_regid);
+void mcuDropCoalescedWrite(u8 led_regid);
+Result mcuFlushCoalescedWrites();
+s64 mcuRunCoalescedWrites(s64 now);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef _MCU_DRIFT_H
+#define _MCU_DRIFT_H
+
+#include <3ds/types.h>
+
+#define RTC_DRIFT_SAMPLE_COUNT    32
+#define RTC_DRIFT_INTERVAL_S      600
+#define RTC_DRIFT_MIN_SAMPLES     8   /* before there is a recommendation at all */
+#define RTC_DRIFT_MAX_RESIDUAL_US 20000 /* auto apply only trusts a fit at least this good */
+
+/*
+	MCU_RtcCorrectionData steps: with interval_mode 0 the offset is applied every
+	20 seconds, 3.052ppm per step, with interval_mode 1 every 60 seconds, 1.017ppm
+	per step. A positive offset slows the RTC down. In 1/256 ppm.
+*/
+#define RTC_CORRECTION_STEP_20S_Q8 781
+#define RTC_CORRECTION_STEP_60S_Q8 260
+
+typedef struct MCU_RtcDriftEstimate {
+	s32 drift_ppm;      /* 1/256 ppm, positive when the RTC runs fast against the system tick */
+	u32 residual_us;    /* mean absolute error of the fit */
+	u32 span_s;         /* seconds between the oldest and newest sample */
+	u8 samples;
+	u8 current;         /* MCU_RtcCorrectionData in the register */
+	u8 recommended;     /* MCU_RtcCorrectionData that would cancel the drift */
+	bool auto_apply;
+} MCU_RtcDriftEstimate;
+
+void mcuGetRtcDriftEstimate(MCU_RtcDriftEstimate *out_estimate);
+void mcuSetRtcDriftAutoApply(bool enabled);
+void mcuResetRtcDrift();
+s64 mcuRunRtcDriftEstimator(s64 now);
+
+#endif
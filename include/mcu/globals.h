@@ -2,6 +2,7 @@
 #define _MCU_GLOBALS_H
 
 #include <3ds/synchronization.h>
+#include <mcu/mcu.h>
 
 extern RecursiveLock g_I2CLock;
 extern RecursiveLock g_GPIOLock;
@@ -14,8 +15,27 @@ extern Handle g_GPIO_MCUInterruptEvent;
 extern Handle g_IRQEvents[3];
 extern u32 g_ReceivedIRQs[3];
 
+extern Handle g_VolumeSliderEvent;
+
+extern RecursiveLock g_BatteryLock;
+extern Handle g_BatteryEvent;
+
+extern Handle g_WorkerEvent;
+
+extern RecursiveLock g_TimerLock;
+extern RecursiveLock g_RtcDriftLock;
+extern RecursiveLock g_WatchLock;
+
+extern RecursiveLock g_LcdSequenceLock;
+extern RecursiveLock g_StatusPageLock;
+extern Handle g_LcdAckEvent;
+
 extern bool g_McuFirmWasUpdated;
 
 extern bool g_IrqHandlerThreadExitFlag;
+extern bool g_WorkerThreadExitFlag;
+
+extern MCU_IrqPollStats g_IrqPollStats;
+extern MCU_BootProfile g_BootProfile;
 
 #endif
\ No newline at end of file
@@ -301,6 +301,16 @@ typedef struct MCU_RtcData {
 	u8 year;
 } MCU_RtcData;
 
+/* registers 0x30-0x3E (RTC time, correction, alarm and tick counter) as read in one transaction */
+typedef struct MCU_ClockSnapshot {
+	s64 tick;              /* svcGetSystemTick() right after the read */
+	MCU_RtcData time;
+	u8 correction;         /* MCU_RtcCorrectionData */
+	MCU_RtcAlarm alarm;
+	u8 reserved;
+	u16 tick_counter;
+} MCU_ClockSnapshot;
+
 typedef struct MCU_RtcCorrectionData {
 	s8 offset : 7;
 	u8 interval_mode : 1;
@@ -313,6 +323,14 @@ typedef struct MCU_AccelerometerData
 	s16 z;
 } MCU_AccelerometerData;
 
+typedef struct __attribute__((packed)) MCU_HidFrame
+{
+	s64 tick; /* system tick right after the registers were read */
+	u8 slider_3d;
+	u8 volume_slider;
+	MCU_AccelerometerData accel;
+} MCU_HidFrame;
+
 typedef struct MCU_PedometerStepData {
 	struct MCU_PedometerTime {
 		u8 hour;
@@ -339,6 +357,13 @@ typedef struct MCU_NotificationLedData {
 	u8 blue_pattern[32];
 } MCU_NotificationLedData;
 
+typedef struct MCU_NotificationLedStats {
+	u32 uploads;          /* full pattern writes that went out */
+	u32 skipped;          /* identical to what the MCU already has */
+	u32 animation_only;   /* only the animation header differed */
+	u32 bytes_saved;
+} MCU_NotificationLedStats;
+
 typedef struct __attribute__((packed)) MCU_StorageArea {
 	u8 firm_flags;
 	u8 lgy_lcd_data;
@@ -378,6 +403,44 @@ typedef struct __attribute__((packed)) MCU_PowerLedConfig
 	u32 blink_pattern;
 } MCU_PowerLedConfig;
 
+typedef struct MCU_IrqPollStats
+{
+	u32 polls;            /* watchdog polls performed after a wait timed out */
+	u32 recoveries;       /* polls that found IRQs the GPIO edge never announced */
+	u32 recovered_irqs;   /* number of IRQ bits delivered by those polls */
+	u32 interval_ms;      /* current poll interval */
+	u32 min_interval_ms;
+	u32 max_interval_ms;
+	u32 max_latency_us;   /* worst-case added latency of a recovered IRQ */
+	u32 total_latency_us; /* sum of added latency over all recoveries */
+} MCU_IrqPollStats;
+
+/* ceiling for the poll interval bounds a client can set, updated by the IRQ thread under g_ExclusiveIRQLock */
+#define IRQ_POLL_MAX_INTERVAL_MS 60000
+
+/* MCU_Main stages, GPIO_BOUND through INTERRUPTS_ENABLED run on the boot thread while the services get registered */
+enum MCU_BootStage {
+	MCU_BOOT_EVENTS_CREATED      = 0,
+	MCU_BOOT_SERVICES_REGISTERED = 1,
+	MCU_BOOT_GPIO_BOUND          = 2, /* GPIO interrupt mask, alarm reset and bind */
+	MCU_BOOT_SNAPSHOT_TAKEN      = 3, /* static registers and storage area */
+	MCU_BOOT_FLAGS_READ          = 4, /* received IRQs and the poweroff firm flag */
+	MCU_BOOT_IRQ_THREAD_STARTED  = 5,
+	MCU_BOOT_INTERRUPTS_ENABLED  = 6, /* volume slider seed and MCU interrupt mask */
+	MCU_BOOT_HARDWARE_READY      = 7, /* boot thread joined */
+	MCU_BOOT_FIRMWARE_CHECKED    = 8,
+	MCU_BOOT_STATUS_PAGE_READY   = 9,
+	MCU_BOOT_BATTERY_SAMPLED     = 10,
+	MCU_BOOT_SERVING             = 11, /* main loop entered */
+	MCU_BOOT_STAGE_COUNT
+};
+
+typedef struct MCU_BootProfile
+{
+	s64 start_tick;                        /* svcGetSystemTick at MCU_Main entry */
+	u32 stage_us[MCU_BOOT_STAGE_COUNT];    /* time since start_tick each stage finished at, 0 if it didn't yet */
+} MCU_BootProfile;
+
 enum {
 	NOLOCK = false,
 	LOCK = true,
@@ -404,6 +467,8 @@ Result gpioMcuReadData(u32 *out_value, u32 mask);
 Result gpioMcuWriteData(u32 value, u32 mask);
 Result gpioMcuBindInterrupt(u32 irq_mask, Handle syncobj, s32 priority);
 Result gpioMcuUnbindInterrupt(u32 irq_mask, Handle syncobj);
+Result gpioMcuReadWlanData(u32 *out_value, u32 mask);
+Result gpioMcuWriteWlanData(u32 value, u32 mask);
 /* locked i2c mcu commands */
 Result gpioMcuSetRegPart1_l(u32 value, u32 mask);
 Result gpioMcuSetInterruptMask_l(u32 value, u32 mask);
@@ -411,15 +476,31 @@ Result gpioMcuReadData_l(u32 *out_value, u32 mask);
 Result gpioMcuWriteData_l(u32 value, u32 mask);
 Result gpioMcuBindInterrupt_l(u32 irq_mask, Handle syncobj, s32 priority);
 Result gpioMcuUnbindInterrupt_l(u32 irq_mask, Handle syncobj);
+Result gpioMcuReadWlanData_l(u32 *out_value, u32 mask);
+Result gpioMcuWriteWlanData_l(u32 value, u32 mask);
+Result gpioMcuSnapshotWlan(u32 *out_snapshot);
+Result gpioMcuRestoreWlan(u32 snapshot);
 
 /* interrupt notifications */
 void mcuHandleInterruptEvents(u32 received_irqs);
 
+/* exclusive interrupt mode */
+#define EXCLUSIVE_IRQ_DEFAULT_LEASE_MS 3000
+#define EXCLUSIVE_IRQ_MAX_LEASE_MS     60000
+
+Result mcuEnterExclusiveIrqMode(void *owner, u32 timeout_ms, u32 *out_token);
+Result mcuLeaveExclusiveIrqMode(u32 token);
+void mcuReleaseExclusiveIrqMode(void *owner);
+u32 mcuTakeExclusiveIrqs(void *owner);
+s64 mcuUpdateExclusiveIrqLease(s64 now);
+bool mcuQueueExclusiveIrqs(u32 received_irqs, s64 tick);
+
 /* wrappers for mcu regs */
 Result mcuUpdateFirmware(const void *payload, u32 payload_size, bool lock);
 
 Result mcuReadFwVerHigh(u8 *out_value, bool lock);
 Result mcuReadFwVerLow(u8 *out_value, bool lock);
+Result mcuReadFwVersion(u8 *out_high, u8 *out_low, bool lock);
 
 Result mcuGetResetEventFlags(u8 *out_value, bool lock);
 Result mcuClearResetEventFlag(u8 to_clear, bool lock);
@@ -427,12 +508,21 @@ Result mcuClearResetEventFlag(u8 to_clear, bool lock);
 Result mcuSetLcdFlicker(bool top, u8 value, bool lock);
 Result mcuGetLcdFlicker(bool top, u8 *out_value, bool lock);
 
+#define VOLUME_LEVEL_MAX 63
+
 Result mcuRead3dSliderPosition(u8 *out_pos, bool lock);
+Result mcuRefreshVolumeSlider(bool lock);
+Result mcuLoadVolumeCalibration(bool lock);
 Result mcuReadVolumeSliderPositiion(u8 *out_pos, bool lock);
+Result mcuGetVolumeLevel(u8 *out_level, u8 *out_raw, bool lock);
 
 Result mcuSetBacklightPowerState(u8 top_bl_on, u8 bottom_bl_on, bool lock);
 Result mcuSetPowerState(u8 triggers, bool lock);
 Result mcuSetLcdPowerState(u8 state, bool lock);
+/* g_LcdSequenceLock is held for the whole wait, so no caller gets to hold it longer than this */
+#define LCD_SEQUENCE_MAX_TIMEOUT_MS 2000
+
+Result mcuSequenceLcdPower(bool lcd_on, bool top_bl_on, bool bottom_bl_on, u32 timeout_ms, u32 *out_acked_irqs, u32 *out_latency_us);
 Result mcuReset(bool lock);
 Result mcuSetForceShutdownDelay(u8 value, bool lock);
 Result mcuGetForceShutdownDelay(u8 *out_value, bool lock);
@@ -452,13 +542,20 @@ Result mcuGetInterruptMask(u32 *out_enabled_interrupts, bool lock);
 
 Result mcuSetLedState(u8 led_regid, u8 state, bool lock);
 Result mcuGetLedState(u8 led_regid, u8 *out_state, bool lock);
+Result mcuSetPowerLedState(u8 state, bool lock);
+Result mcuGetPowerLedState(u8 *out_state, bool lock);
+Result mcuSetPowerLedConfig(const MCU_PowerLedConfig *config, bool lock);
 Result mcuSetPowerLedBlinkPattern(u32 blink_pattern, bool lock);
 Result mcuSetNotificationLedData(MCU_NotificationLedData *data, bool lock);
 Result mcuSetNotificationLedAnimation(MCU_NotifictationLedAnimation *animation, bool lock);
 Result mcuGetNotificationLedCycleState(u8 *out_state, bool lock);
+void mcuGetNotificationLedStats(MCU_NotificationLedStats *out_stats);
 
 Result mcuSetRtcTime(MCU_RtcData *data, bool lock);
 Result mcuGetRtcTime(MCU_RtcData *out_data, bool lock);
+u32 mcuRtcSeconds(const MCU_RtcData *time);
+Result mcuGetRtcSeconds(u32 *out_seconds, bool lock);
+Result mcuReadClockSnapshot(MCU_ClockSnapshot *out_snapshot, bool lock);
 Result mcuSetRtcTimeField(u8 field_regid, u8 value, bool lock);
 Result mcuGetRtcTimeField(u8 field_regid, u8 *out_value, bool lock);
 Result mcuSetRtcTimeCorrection(u8 value, bool lock);
@@ -487,6 +584,7 @@ Result mcuGetAccelerometerInternalFilterEnabled(u8 *out_enabled, bool lock);
 Result mcuSetAccelerometerScale(u8 scale, bool lock);
 Result mcuGetAccelerometerScale(u8 *out_scale, bool lock);
 Result mcuReadAccelerometerData(MCU_AccelerometerData *out_data, bool lock);
+Result mcuReadHidFrame(MCU_HidFrame *out_frame, s64 max_age, bool lock);
 Result mcuSetPedometerWrapTimeMinute(u8 value, bool lock);
 Result mcuGetPedometerWrapTimeMinute(u8 *out_value, bool lock);
 Result mcuSetPedometerWrapTimeSecond(u8 value, bool lock);
@@ -499,6 +597,7 @@ Result mcuReadStorageArea(u8 offset, void *outbuf, u32 size, bool lock);
 Result mcuWriteStorageArea(u8 offset, void *inbuf, u32 size, bool lock);
 Result mcuSetFirmFlag(u8 flag, bool set, bool lock);
 Result mcuGetFirmFlag(bool *out_is_set, u8 flag, bool lock);
+Result mcuTakeFirmFlag(bool *out_was_set, u8 flag, bool lock);
 
 Result mcuReadInfoRegisters(void *outbuf, u32 size, bool lock);
 
@@ -0,0 +1,45 @@
+#ifndef _MCU_NOTIFLED_H
+#define _MCU_NOTIFLED_H
+
+#include <3ds/types.h>
+#include <mcu/mcu.h>
+
+#define NOTIFICATION_LED_LAYER_COUNT 8
+
+/* owner of the layer set through the original notification LED commands, it lives forever at the lowest priority */
+#define NOTIFICATION_LED_LEGACY_OWNER    ((void *)1)
+#define NOTIFICATION_LED_LEGACY_PRIORITY 0
+
+/* generated patterns kept around, least recently used goes first */
+#define NOTIFICATION_LED_PATTERN_CACHE_SIZE 4
+
+#define NOTIFICATION_LED_PATTERN_STEPS 32
+
+enum MCU_NotificationLedWaveform {
+	MCU_LED_WAVE_SOLID   = 0,
+	MCU_LED_WAVE_BREATHE = 1, /* eased fade in and out */
+	MCU_LED_WAVE_BLINK   = 2, /* on for the first half of the period */
+	MCU_LED_WAVE_RAMP    = 3, /* fade in, then cut */
+};
+
+/* compact description of a notification LED pattern, expanded into the 32 step colour patterns */
+typedef struct MCU_NotificationLedPattern {
+	u8 waveform;
+	u8 red;
+	u8 green;
+	u8 blue;
+	u8 period;   /* steps per cycle, 1-32 */
+	u8 phase;    /* steps the first cycle starts into */
+	u8 repeats;  /* cycles before the LED stays dark, 0 to fill all steps */
+	u8 reserved;
+	MCU_NotifictationLedAnimation animation;
+} MCU_NotificationLedPattern;
+
+Result mcuSetNotificationLedLayer(void *owner, u8 priority, u32 duration_ms, const MCU_NotificationLedData *data);
+Result mcuSetNotificationLedLayerPattern(void *owner, u8 priority, u32 duration_ms, const MCU_NotificationLedPattern *pattern);
+Result mcuSetNotificationLedLayerAnimation(void *owner, const MCU_NotifictationLedAnimation *animation);
+Result mcuClearNotificationLedLayer(void *owner);
+void mcuReleaseNotificationLedLayers(void *owner);
+s64 mcuRunNotificationLedLayers(s64 now);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef _MCU_PEDOMETER_H
+#define _MCU_PEDOMETER_H
+
+#include <3ds/types.h>
+#include <mcu/mcu.h>
+
+#define PEDOMETER_HOURS (7 * 24)
+
+#define STEP_SUBSCRIPTION_COUNT 8
+
+/* shared step count poll interval, stretched while the accelerometer sees no motion */
+#define STEP_POLL_MIN_MS       1000
+#define STEP_POLL_MAX_MS       30000
+#define STEP_MOTION_THRESHOLD  64 /* raw accelerometer units on any axis */
+
+/* the MCU step counter is 24 bits wide, a larger delta would wrap the target */
+#define STEP_DELTA_MAX 0xFFFFFF
+
+enum MCU_StepSubscriptionType {
+	MCU_STEPS_DELTA    = 0, /* every `value` steps from now on */
+	MCU_STEPS_ABSOLUTE = 1, /* once, when the step count reaches `value` */
+};
+
+/* one hourly step count, keyed by hours since 2000-01-01 00:00 */
+typedef struct MCU_PedometerBucket {
+	u32 hour;
+	u16 steps;
+	u16 reserved;
+} MCU_PedometerBucket;
+
+typedef struct MCU_PedometerStats {
+	u32 generation;      /* step data generation these were computed from */
+	u32 week_total;      /* all PEDOMETER_HOURS hours */
+	u32 day_totals[7];   /* [0] is today so far, then the six days before it */
+	u16 peak_steps;
+	u8 peak_hours_ago;
+	u8 active_hours;     /* hours with any steps at all */
+} MCU_PedometerStats;
+
+Result mcuReadPedometerStepDataCached(MCU_PedometerStepData *out_data, bool lock);
+Result mcuGetPedometerChangesSince(u32 generation, MCU_PedometerBucket *out_buckets, u32 max_buckets, u32 *out_count, u32 *out_generation, bool lock);
+Result mcuGetPedometerStats(MCU_PedometerStats *out_stats, bool lock);
+void mcuInvalidatePedometerCache();
+
+Result mcuSubscribeSteps(void *owner, u8 type, u32 value, u32 *out_id, Handle *out_event);
+Result mcuUnsubscribeSteps(void *owner, u32 id);
+void mcuReleaseStepSubscriptions(void *owner);
+s64 mcuRunStepSubscriptions(s64 now);
+
+#endif
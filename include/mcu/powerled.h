@@ -0,0 +1,29 @@
+#ifndef _MCU_POWERLED_H
+#define _MCU_POWERLED_H
+
+#include <3ds/types.h>
+#include <mcu/mcu.h>
+
+#define POWER_LED_SEQUENCE_STEPS 8
+
+typedef struct MCU_PowerLedStep {
+	u8 mode;
+	u8 reserved[3];
+	u32 blink_pattern;
+	u32 duration_ms; /* 0 to hold this step until the sequence is stopped */
+} MCU_PowerLedStep;
+
+/* power LED configs played one after another, e.g. a critical battery pulse that gets more urgent over time */
+typedef struct MCU_PowerLedSequence {
+	u8 count;
+	bool loop; /* start over after the last step instead of holding it */
+	u8 reserved[2];
+	MCU_PowerLedStep steps[POWER_LED_SEQUENCE_STEPS];
+} MCU_PowerLedSequence;
+
+Result mcuStartPowerLedSequence(void *owner, const MCU_PowerLedSequence *sequence);
+void mcuStopPowerLedSequence();
+void mcuReleasePowerLedSequence(void *owner);
+s64 mcuRunPowerLedSequence(s64 now);
+
+#endif
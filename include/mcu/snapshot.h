@@ -0,0 +1,21 @@
+#ifndef _MCU_SNAPSHOT_H
+#define _MCU_SNAPSHOT_H
+
+#include <3ds/types.h>
+#include <mcu/mcu.h>
+
+/* leading MCU_InfoRegs bytes that never change at runtime, longer reads always go to the bus */
+#define SNAPSHOT_INFO_STATIC_SIZE offsetof(MCU_InfoRegs, raw_battery_pcb_temp_adc)
+
+Result mcuTakeRegisterSnapshot();
+void mcuDropRegisterSnapshot();
+Result mcuSetRegisterSnapshotWarm(bool warm);
+
+bool mcuReadRegisterSnapshot(u8 regid, void *out, u32 size);
+bool mcuReadStorageSnapshot(u8 offset, void *out, u32 size);
+
+void mcuTrackRegisterWrite(u8 regid, const void *buf, u32 size, bool succeeded);
+void mcuTrackRegisterBits(u8 regid, u8 mask, u8 data, bool succeeded);
+void mcuTrackRegisterRead(u8 regid);
+
+#endif
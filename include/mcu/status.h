@@ -0,0 +1,51 @@
+#ifndef _MCU_STATUS_H
+#define _MCU_STATUS_H
+
+#include <3ds/types.h>
+#include <mcu/battery.h>
+
+#define MCU_STATUS_PAGE_VERSION 1
+#define MCU_STATUS_PAGE_SIZE    0x1000
+
+/*
+	Read-only page shared with clients, mapped from the memory block handed out
+	by the status page commands. It's a seqlock: a reader copies what it needs,
+	and retries if `sequence` was odd or changed in the meantime. The layout is
+	fixed, one 32 byte cache line for the fields that change at runtime and one
+	for those that mostly don't.
+*/
+typedef struct MCU_StatusPage {
+	/* first cache line */
+	u32 sequence;            /* odd while an update is in progress */
+	u32 version;             /* MCU_STATUS_PAGE_VERSION */
+	u8 power_status;         /* MCU_PWRSTAT_* */
+	u8 battery_temperature;  /* degrees celsius */
+	u8 battery_voltage;      /* 20mV units */
+	u8 volume_slider;        /* raw position */
+	u8 volume_level;         /* 0-VOLUME_LEVEL_MAX */
+	u8 reserved0;
+	u16 battery_percentage;  /* 8.8 fixed point */
+	u32 updates;
+	u32 reserved1;
+	s64 updated_tick;        /* system tick of the last update */
+	/* second cache line */
+	u8 fw_version_high;
+	u8 fw_version_low;
+	u8 power_led_state;
+	u8 wlan_led_state;
+	u8 camera_led_state;
+	u8 led_3d_state;
+	u8 led_brightness;
+	u8 reserved2[25];
+} __attribute__((aligned(32))) MCU_StatusPage;
+
+Result mcuInitStatusPage();
+void mcuExitStatusPage();
+Handle mcuGetStatusPageBlock();
+
+void mcuPublishPowerStatus(u8 power_status);
+void mcuPublishBatterySample(const MCU_BatterySample *sample, u8 power_status);
+void mcuPublishVolumeSlider(u8 raw, u8 level);
+void mcuPublishLedState(u8 led_regid, u8 state);
+
+#endif
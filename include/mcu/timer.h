@@ -0,0 +1,26 @@
+#ifndef _MCU_TIMER_H
+#define _MCU_TIMER_H
+
+#include <3ds/types.h>
+
+#define TIMER_COUNT       16
+#define TIMER_OWNER_COUNT 8
+
+/* timers at least this long also get a coarse RTC alarm, in case the console sleeps (and the system tick stops) on the way */
+#define TIMER_COARSE_MIN_MS 120000
+
+typedef struct MCU_TimerStats {
+	u32 fired;
+	u32 last_late_us;
+	u32 max_late_us;
+	u32 total_late_us;
+} MCU_TimerStats;
+
+Result mcuStartTimer(void *owner, u32 ms, u32 *out_id, Handle *out_event);
+Result mcuCancelTimer(void *owner, u32 id);
+void mcuReleaseTimers(void *owner);
+void mcuGetTimerStats(MCU_TimerStats *out_stats);
+void mcuResyncTimers(u32 alarm_id);
+s64 mcuRunTimers(s64 now);
+
+#endif
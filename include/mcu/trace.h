@@ -0,0 +1,40 @@
+#ifndef _MCU_TRACE_H
+#define _MCU_TRACE_H
+
+#include <3ds/types.h>
+
+#define IRQ_TRACE_RECORD_COUNT 64 /* must be a power of two */
+
+/*
+	One record per IRQ thread wakeup that had IRQs to deliver. All deltas are in
+	system ticks (SYSCLOCK_ARM11) relative to wake_tick, so a dump can be turned
+	into trace events offline without knowing anything else about the module,
+	tools/irqtrace2chrome.py does that for chrome://tracing.
+*/
+typedef struct MCU_IrqTraceRecord {
+	s64 wake_tick;      /* GPIO event (or watchdog poll) woke the IRQ thread */
+	u32 lock_wait;      /* spent waiting for g_ExclusiveIRQLock */
+	u32 read_done;      /* received IRQs have been read over I2C */
+	u32 dispatch_done;  /* events signalled and notifications published */
+	u32 irqs;
+} MCU_IrqTraceRecord;
+
+typedef struct MCU_IrqTracePercentiles {
+	u32 p50_us;
+	u32 p90_us;
+	u32 p99_us;
+	u32 max_us;
+} MCU_IrqTracePercentiles;
+
+typedef struct MCU_IrqTraceSummary {
+	u32 total_records; /* every record ever written, the ring only keeps the newest IRQ_TRACE_RECORD_COUNT */
+	u32 samples;       /* records the percentiles below were computed from */
+	MCU_IrqTracePercentiles read;     /* wake to I2C read done */
+	MCU_IrqTracePercentiles dispatch; /* wake to dispatch done */
+} MCU_IrqTraceSummary;
+
+void mcuTraceIrq(s64 wake_tick, s64 locked_tick, s64 read_tick, s64 dispatch_tick, u32 irqs);
+u32 mcuDumpIrqTrace(MCU_IrqTraceRecord *out_records, u32 max_records, u32 *out_total);
+void mcuGetIrqTraceSummary(MCU_IrqTraceSummary *out_summary);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef _MCU_WATCH_H
+#define _MCU_WATCH_H
+
+#include <3ds/types.h>
+
+#define REGISTER_WATCH_COUNT 16
+
+#define REGISTER_WATCH_MIN_INTERVAL_MS 10
+/* longest run of adjacent watched registers read in one transaction */
+#define REGISTER_WATCH_MERGE_MAX       16
+
+Result mcuAddRegisterWatch(void *owner, u8 regid, u8 mask, u32 interval_ms, u32 *out_id, u8 *out_value, Handle *out_event);
+Result mcuRemoveRegisterWatch(void *owner, u32 id);
+void mcuReleaseRegisterWatches(void *owner);
+s64 mcuRunRegisterWatches(s64 now);
+
+#endif
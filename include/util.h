@@ -1,6 +1,8 @@
 #ifndef MCU_UTIL_H
 #define MCU_UTIL_H
 
+#include <3ds/types.h>
+
 #define INT2BCD(x) ((x) + 6u * (((x) * 103u)>>10))
 #define BCD2INT(x) ((x) - 6u * ((x)>>4))
 #define CHECKBIT(x,y) (((x) & (y)) == (y))
@@ -8,4 +10,21 @@
 #define LODWORD(x) ((u32)(x & 0xFFFFFFFF))
 #define HIDWORD(x) ((u32)((x >> 32) & 0xFFFFFFFF))
 
+#define SYSCLOCK_ARM11 268111856
+
+/* no divider on the ARM11, so scale by a fixed-point reciprocal of SYSCLOCK_ARM11 instead */
+#define TICKS_TO_US(x) ((u32)(((s64)(x) * 62575) >> 24))
+#define TICKS_TO_NS(x) (((s64)(x) * 244436) >> 16)
+#define TICKS_TO_S(x) ((u32)((((u64)(x) >> 12) * 65615) >> 32))
+#define MS_TO_TICKS(x) ((s64)(x) * (SYSCLOCK_ARM11 / 1000))
+#define US_TO_TICKS(x) ((s64)(x) * (SYSCLOCK_ARM11 / 1000000))
+
+u32 daysSince2000(u32 year, u32 month, u32 day);
+void dateFromDaysSince2000(u32 days, u8 *out_year, u8 *out_month, u8 *out_day);
+
+/* we don't link libgcc, so division by anything that isn't a constant goes through these */
+u32 udiv32(u32 n, u32 d);
+u64 udiv64(u64 n, u64 d);
+s64 sdiv64(s64 n, s64 d);
+
 #endif
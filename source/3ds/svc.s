@@ -137,6 +137,15 @@ BEGIN_ASM_FUNC svcOutputDebugString
 	bx  lr
 END_ASM_FUNC
 
+BEGIN_ASM_FUNC svcCreateMemoryBlock
+	str r0, [sp, #-4]!
+	ldr r0, [sp, #4]
+	svc 0x1E
+	ldr r2, [sp], #4
+	str r1, [r2]
+	bx  lr
+END_ASM_FUNC
+
 BEGIN_ASM_FUNC svcCreateEvent
 	str r0, [sp, #-4]!
 	svc 0x17
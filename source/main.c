@@ -1,16 +1,29 @@
 #include <3ds/synchronization.h>
 #include <mcu/globals.h>
+#include <mcu/pedometer.h>
+#include <mcu/snapshot.h>
+#include <mcu/status.h>
+#include <mcu/coalesce.h>
+#include <mcu/powerled.h>
+#include <mcu/notifled.h>
+#include <mcu/battery.h>
+#include <mcu/alarm.h>
+#include <mcu/timer.h>
+#include <mcu/watch.h>
+#include <mcu/drift.h>
 #include <3ds/result.h>
 #include <3ds/types.h>
 #include <3ds/gpio.h>
 #include <3ds/svc.h>
 #include <3ds/i2c.h>
 #include <3ds/srv.h>
+#include <mcu/trace.h>
 #include <mcu/ipc.h>
 #include <mcu/mcu.h>
 #include <3ds/os.h>
 #include <memops.h>
 #include <stdint.h>
+#include <util.h>
 
 #ifdef ENABLE_FIRM_UPLOAD
 const char mcu_firm[] = {
@@ -47,14 +60,15 @@ static const struct
 	{ .name = "mcu::CDC", .pre_serve = NULL           , .post_serve = NULL            , .len = sizeof("mcu::CDC") - 1 }
 };
 
-// 9 ipc server threads and irq handler thread
+// 9 ipc server threads, irq handler thread and worker thread
 #ifdef DEBUG
 // increase stack size to account for unoptimized code
-__attribute__((section(".data.thread_stacks"), aligned(8))) static u8 MCU_ThreadStacks[MCU_MAX_TOTAL_SESSIONS + 1][0x500] = { 0 };
+__attribute__((section(".data.thread_stacks"), aligned(8))) static u8 MCU_ThreadStacks[MCU_MAX_TOTAL_SESSIONS + 2][0x500] = { 0 };
 #else
-__attribute__((section(".data.thread_stacks"), aligned(8))) static u8 MCU_ThreadStacks[MCU_MAX_TOTAL_SESSIONS + 1][0x400] = { 0 };
+__attribute__((section(".data.thread_stacks"), aligned(8))) static u8 MCU_ThreadStacks[MCU_MAX_TOTAL_SESSIONS + 2][0x400] = { 0 };
 #endif
 __attribute__((section(".data.irqh_exit_flag"))) bool g_IrqHandlerThreadExitFlag;
+__attribute__((section(".data.worker_exit_flag"))) bool g_WorkerThreadExitFlag;
 __attribute__((section(".data.session_data"))) static MCU_SessionData MCU_SessionsData[MCU_MAX_TOTAL_SESSIONS] = { 0 };
 
 void _thread_start(void *);
@@ -128,6 +142,15 @@ void MCU_SessionThreadMain(void *arg)
 
 	T(svcCloseHandle(data->session))
 	
+	/* a client that goes away must not keep the IRQ thread from delivering interrupts */
+	mcuReleaseExclusiveIrqMode(getThreadLocalStorage());
+	mcuReleaseStepSubscriptions(getThreadLocalStorage());
+	mcuReleaseRtcAlarms(getThreadLocalStorage());
+	mcuReleaseTimers(getThreadLocalStorage());
+	mcuReleaseNotificationLedLayers(getThreadLocalStorage());
+	mcuReleaseRegisterWatches(getThreadLocalStorage());
+	mcuReleasePowerLedSequence(getThreadLocalStorage());
+	
 	if (data->post_serve)
 		data->post_serve();
 }
@@ -143,26 +166,153 @@ static inline void initializeBSS()
 #define SRV_NOTIF_REPLY(idx) (idx == 0) // handles[0]
 #define SERVICE_REPLY(idx) (idx > 0 && idx < MCU_SERVICE_COUNT + 1) // handles[1] until handles[9]
 
+/* watchdog poll bounds for IRQs whose GPIO edge got lost, in milliseconds */
+#define IRQ_POLL_DEFAULT_MIN_MS 100
+#define IRQ_POLL_DEFAULT_MAX_MS 5000
+
+__attribute__((section(".data.irq_poll_stats"))) MCU_IrqPollStats g_IrqPollStats = {
+	.interval_ms     = IRQ_POLL_DEFAULT_MIN_MS,
+	.min_interval_ms = IRQ_POLL_DEFAULT_MIN_MS,
+	.max_interval_ms = IRQ_POLL_DEFAULT_MAX_MS,
+};
+
+MCU_BootProfile g_BootProfile;
+
+static inline void bootStage(u32 stage)
+{
+	g_BootProfile.stage_us[stage] = TICKS_TO_US(svcGetSystemTick() - g_BootProfile.start_tick);
+}
+
+static inline u32 countBits(u32 value)
+{
+	u32 count = 0;
+	
+	for (; value; value &= value - 1)
+		count++;
+	
+	return count;
+}
+
+static void updateIrqPollStats(u32 received_irqs, s64 since_last_read)
+{
+	MCU_IrqPollStats *stats = &g_IrqPollStats;
+	
+	stats->polls++;
+	
+	if (received_irqs) {
+		/* the IRQs arrived at some point since the registers were last seen empty, so that is the worst case */
+		u32 latency_us = TICKS_TO_US(since_last_read);
+		
+		stats->recoveries++;
+		stats->recovered_irqs += countBits(received_irqs);
+		stats->total_latency_us += latency_us;
+		stats->max_latency_us = MAX(stats->max_latency_us, latency_us);
+		
+		/* edges are being lost, look more often */
+		stats->interval_ms = MAX(stats->interval_ms >> 1, stats->min_interval_ms);
+	} else {
+		/* nothing pending, back off so an idle bus stays idle, doubling no further than the maximum */
+		stats->interval_ms = stats->interval_ms >= (stats->max_interval_ms >> 1) ? stats->max_interval_ms : stats->interval_ms << 1;
+	}
+}
+
 void MCU_IRQHandlerMain(void *arg) {
 	(void)arg;
 	
+	s64 last_read = svcGetSystemTick();
+	
 	while (1) {
-		T(svcWaitSynchronization(g_GPIO_MCUInterruptEvent, -1));
+		s64 now = svcGetSystemTick();
+		s64 timeout = (s64)g_IrqPollStats.interval_ms * 1000000;
+		
+		/* an expired exclusive mode lease is ended (and its IRQs replayed) here, otherwise wake up when it expires */
+		s64 lease_deadline = mcuUpdateExclusiveIrqLease(now);
+		
+		if (lease_deadline)
+			timeout = MIN(timeout, TICKS_TO_NS(lease_deadline - now));
+		
+		Result res = svcWaitSynchronization(g_GPIO_MCUInterruptEvent, timeout);
+		
+		if (R_FAILED(res))
+			Err_Throw(res);
+		
+		s64 wake_tick = svcGetSystemTick();
 		
 		RecursiveLock_Lock(&g_ExclusiveIRQLock);
 		
 		if (g_IrqHandlerThreadExitFlag)
 			break;
 		
+		s64 locked_tick = svcGetSystemTick();
+		
 		u32 received_irqs = 0;
 		T(mcuGetReceivedIrqs(&received_irqs, LOCK));
 		
-		mcuHandleInterruptEvents(received_irqs);
+		now = svcGetSystemTick();
+		
+		/* timed out: check whether the received IRQ registers hold anything the GPIO edge did not announce */
+		if (res == OS_TIMEOUT)
+			updateIrqPollStats(received_irqs, now - last_read);
+		
+		last_read = now;
+		
+		if (received_irqs) {
+			/* while a client holds exclusive mode, IRQs are queued rather than delivered */
+			if (!mcuQueueExclusiveIrqs(received_irqs, now))
+				mcuHandleInterruptEvents(received_irqs);
+			
+			mcuTraceIrq(wake_tick, locked_tick, now, svcGetSystemTick(), received_irqs);
+		}
 		
 		RecursiveLock_Unlock(&g_ExclusiveIRQLock);
 	}
 }
 
+/* background work that has no IRQ to hang off, woken early through g_WorkerEvent */
+void MCU_WorkerThreadMain(void *arg) {
+	(void)arg;
+	
+	while (1) {
+		s64 now = svcGetSystemTick();
+		s64 deadline = mcuRunBatterySampler(now);
+		s64 steps_deadline = mcuRunStepSubscriptions(now);
+		
+		s64 timers_deadline = mcuRunTimers(now);
+		s64 led_deadline = mcuRunNotificationLedLayers(now);
+		s64 power_led_deadline = mcuRunPowerLedSequence(now);
+		s64 coalesce_deadline = mcuRunCoalescedWrites(now);
+		s64 watch_deadline = mcuRunRegisterWatches(now);
+		
+		deadline = MIN(deadline, mcuRunRtcDriftEstimator(now));
+		
+		if (steps_deadline)
+			deadline = MIN(deadline, steps_deadline);
+		
+		if (timers_deadline)
+			deadline = MIN(deadline, timers_deadline);
+		
+		if (led_deadline)
+			deadline = MIN(deadline, led_deadline);
+		
+		if (power_led_deadline)
+			deadline = MIN(deadline, power_led_deadline);
+		
+		if (coalesce_deadline)
+			deadline = MIN(deadline, coalesce_deadline);
+		
+		if (watch_deadline)
+			deadline = MIN(deadline, watch_deadline);
+		
+		Result res = svcWaitSynchronization(g_WorkerEvent, TICKS_TO_NS(MAX(deadline - now, 0)));
+		
+		if (R_FAILED(res))
+			Err_Throw(res);
+		
+		if (g_WorkerThreadExitFlag)
+			break;
+	}
+}
+
 const vu8 *const CFG_PREV_FIRM = (vu8 *const)0x1FF80016;
 
 #define DEFAULT_ENABLED_IRQS MCUINT_POWER_BUTTON_PRESS | MCUINT_POWER_BUTTON_HELD | \
@@ -170,11 +320,78 @@ const vu8 *const CFG_PREV_FIRM = (vu8 *const)0x1FF80016;
                              MCUINT_WLAN_SWITCH_TRIGGER | MCUINT_SHELL_CLOSE | \
                              MCUINT_SHELL_OPEN | MCUINT_FATAL_HW_ERROR | \
                              MCUINT_AC_ADAPTER_REMOVED | MCUINT_AC_ADAPTER_PLUGGED_IN | \
-                             MCUINT_CHARGING_STOP | MCUINT_CHARGING_START
+                             MCUINT_CHARGING_STOP | MCUINT_CHARGING_START | \
+                             MCUINT_VOL_SLIDER | MCUINT_RTC_ALARM
+
+/* what the boot thread hands back to MCU_Main */
+typedef struct MCU_BootState
+{
+	Handle *irq_thread;
+	bool signal_poweroff;
+} MCU_BootState;
+
+/*
+	Hardware half of the boot. It runs on its own thread, on the worker
+	thread's stack that isn't in use yet, so its bus round-trips overlap the
+	SRV registrations of the main thread. Nothing in here depends on the
+	services being registered, and no session is accepted before MCU_Main
+	has joined it.
+*/
+static void MCU_BootThreadMain(void *arg)
+{
+	MCU_BootState *state = (MCU_BootState *)arg;
+	
+	// enable GPIO<--->MCU interrupt
+	T(gpioMcuSetInterruptMask_l(GPIO_MCU_INTERRUPT, GPIO_MCU_INTERRUPT));
+	
+	{
+		MCU_RtcAlarm alarm = { 0, 0, 0, 0, 0 };
+		T(mcuSetRtcAlarm(&alarm, LOCK));
+	}
+	T(gpioMcuBindInterrupt_l(GPIO_MCU_INTERRUPT, g_GPIO_MCUInterruptEvent, 8));
+	bootStage(MCU_BOOT_GPIO_BOUND);
+	
+	/* everything static in a few transactions, the reads below and most later ones are served from it */
+	T(mcuSetRegisterSnapshotWarm(true));
+	bootStage(MCU_BOOT_SNAPSHOT_TAKEN);
+	
+	u32 atboot_irqs = 0;
+	bool poweroff_flag = false;
+	
+	/* the flags come from the snapshot, they are only written back if the poweroff one was set */
+	I2C_LOCKED({
+		T(mcuGetReceivedIrqs(&atboot_irqs, NOLOCK));
+		T(mcuTakeFirmFlag(&poweroff_flag, MCU_FIRMFLG_POWEROFF_INITIATED, NOLOCK));
+	})
+	bootStage(MCU_BOOT_FLAGS_READ);
+	
+	/* if there is already a poweroff pending, or if not, if the power button is held */
+	if (poweroff_flag || (atboot_irqs & MCUINT_POWER_BUTTON_HELD))
+	{
+		/* then if the power button was actually held, or we ended up here because of a reset (indicated by PREV_FIRM), initiate a poweroff */
+		if ((atboot_irqs & MCUINT_POWER_BUTTON_HELD) || *CFG_PREV_FIRM == PREV_CTR_MODE_RESET)
+			state->signal_poweroff = true;
+	}
+	
+	// handles[10] - irq handler thread
+	T(startThread(state->irq_thread, &MCU_IRQHandlerMain, NULL, &MCU_ThreadStacks[10], 11, -2));
+	bootStage(MCU_BOOT_IRQ_THREAD_STARTED);
+	
+	// seed the volume slider cache before MCUINT_VOL_SLIDER starts keeping it current
+	I2C_LOCKED({
+		T(mcuLoadVolumeCalibration(NOLOCK));
+		T(mcuRefreshVolumeSlider(NOLOCK));
+	})
+	
+	// set default interrupt mask
+	T(mcuSetInterruptMask(DEFAULT_ENABLED_IRQS, LOCK));
+	bootStage(MCU_BOOT_INTERRUPTS_ENABLED);
+}
 
 void MCU_Main()
 {
 	initializeBSS();
+	g_BootProfile.start_tick = svcGetSystemTick();
 
 	T(srvInit());
 	T(syncInit());
@@ -193,67 +410,57 @@ void MCU_Main()
 		handles[8]  = mcu::PLS server handle
 		handles[9]  = mcu::CDC server handle
 		handles[10] = IRQ handler thread
+		handles[11] = worker thread
 	*/
-	Handle handles[MCU_SERVICE_COUNT + 2];
+	Handle handles[MCU_SERVICE_COUNT + 3];
 	
 	// globals init
 	RecursiveLock_Init(&g_I2CLock);
 	RecursiveLock_Init(&g_GPIOLock);
 	RecursiveLock_Init(&g_ExclusiveIRQLock);
+	RecursiveLock_Init(&g_BatteryLock);
+	RecursiveLock_Init(&g_TimerLock);
+	RecursiveLock_Init(&g_RtcDriftLock);
+	RecursiveLock_Init(&g_WatchLock);
+	RecursiveLock_Init(&g_LcdSequenceLock);
+	RecursiveLock_Init(&g_StatusPageLock);
 	
 	LightEvent_Init(&g_AccelerometerManualI2CEvent, false);
 	
-	// handles[0] - srv notification event
-	T(SRV_EnableNotification(&handles[0]));
-
-	// handles[1] through handles[9] - services
-	for (u8 i = 0, j = 1; i < MCU_SERVICE_COUNT; i++, j++)
-		T(SRV_RegisterService(&handles[j], MCU_ServiceConfigs[i].name, MCU_ServiceConfigs[i].len, MCU_MAX_SESSIONS_PER_SERVICE));
-	
 	T(svcCreateEvent(&g_GPIO_MCUInterruptEvent, RESET_ONESHOT));
 	
 	T(svcCreateEvent(&g_IRQEvents[EVENT_GPU], RESET_ONESHOT));
 	T(svcCreateEvent(&g_IRQEvents[EVENT_HID], RESET_ONESHOT));
 	T(svcCreateEvent(&g_IRQEvents[EVENT_POWER], RESET_ONESHOT));
 	
+	T(svcCreateEvent(&g_VolumeSliderEvent, RESET_ONESHOT));
+	T(svcCreateEvent(&g_BatteryEvent, RESET_ONESHOT));
+	T(svcCreateEvent(&g_WorkerEvent, RESET_ONESHOT));
+	T(svcCreateEvent(&g_LcdAckEvent, RESET_ONESHOT));
+	
 	g_McuFirmWasUpdated = false;
 	g_IrqHandlerThreadExitFlag = false;
+	g_WorkerThreadExitFlag = false;
+	bootStage(MCU_BOOT_EVENTS_CREATED);
 	
-	// some setup
+	// some setup, on the boot thread while the services get registered
+	MCU_BootState boot = { .irq_thread = &handles[10], .signal_poweroff = false };
+	Handle boot_thread = 0;
 	
-	// enable GPIO<--->MCU interrupt
-	T(gpioMcuSetInterruptMask_l(GPIO_MCU_INTERRUPT, GPIO_MCU_INTERRUPT));
+	T(startThread(&boot_thread, &MCU_BootThreadMain, &boot, &MCU_ThreadStacks[11], 21, -2));
 	
-	{
-		MCU_RtcAlarm alarm = { 0, 0, 0, 0, 0 };
-		T(mcuSetRtcAlarm(&alarm, LOCK));
-	}
-	T(gpioMcuBindInterrupt_l(GPIO_MCU_INTERRUPT, g_GPIO_MCUInterruptEvent, 8));
-	
-	u32 atboot_irqs = 0;
-	bool poweroff_flag = false;
-	bool signal_poweroff = false;
-	
-	T(mcuGetReceivedIrqs(&atboot_irqs, LOCK));
-	
-	I2C_LOCKED({
-		T(mcuGetFirmFlag(&poweroff_flag, MCU_FIRMFLG_POWEROFF_INITIATED, NOLOCK));
-		T(mcuSetFirmFlag(MCU_FIRMFLG_POWEROFF_INITIATED, false, NOLOCK));
-	})
+	// handles[0] - srv notification event
+	T(SRV_EnableNotification(&handles[0]));
 	
-	/* if there is already a poweroff pending, or if not, if the power button is held */
-	if (poweroff_flag || (atboot_irqs & MCUINT_POWER_BUTTON_HELD))
-	{
-		/* then if the power button was actually held, or we ended up here because of a reset (indicated by PREV_FIRM), initiate a poweroff */
-		if ((atboot_irqs & MCUINT_POWER_BUTTON_HELD) || *CFG_PREV_FIRM == PREV_CTR_MODE_RESET)
-			signal_poweroff = true;
-	}
+	// handles[1] through handles[9] - services
+	for (u8 i = 0, j = 1; i < MCU_SERVICE_COUNT; i++, j++)
+		T(SRV_RegisterService(&handles[j], MCU_ServiceConfigs[i].name, MCU_ServiceConfigs[i].len, MCU_MAX_SESSIONS_PER_SERVICE));
 	
-	// handles[10] - irq handler thread
-	T(startThread(&handles[10], &MCU_IRQHandlerMain, NULL, &MCU_ThreadStacks[10], 11, -2));
+	bootStage(MCU_BOOT_SERVICES_REGISTERED);
 	
-	// set default interrupt mask
-	T(mcuSetInterruptMask(DEFAULT_ENABLED_IRQS, LOCK));
+	// the worker thread's stack is free again once this returns
+	freeThread(&boot_thread);
+	bootStage(MCU_BOOT_HARDWARE_READY);
 
 #ifdef ENABLE_FIRM_UPLOAD
 #pragma GCC diagnostic push
@@ -262,57 +469,61 @@ void MCU_Main()
 #pragma GCC diagnostic pop
 	u8 ver_high = 0, ver_low = 0;
 	
-	I2C_LOCKED({
-		T(mcuReadFwVerHigh(&ver_high, NOLOCK));
-		T(mcuReadFwVerLow(&ver_low, NOLOCK));
-	})
+	T(mcuReadFwVersion(&ver_high, &ver_low, LOCK));
 	
 	if (ver_high < MCU_FIRM_VER_HIGH || (ver_high == MCU_FIRM_VER_HIGH && ver_low < MCU_FIRM_VER_LOW))
 	{
 		u8 wlan_led_state = 0;
-		u32 wlan_mode = 0;
-		u32 wlan_state = 0;
+		u32 wlan_gpio = 0;
 		bool had_wireless_disabled = false;
 		
 		/* read some state to restore after the firmware upgrade */
 		
 		T(mcuGetLedState(MCUREG_WLAN_LED_STATE, &wlan_led_state, LOCK));
-		T(gpioMcuReadData_l(&wlan_mode, GPIO_WLAN_MODE));
-		GPIO_LOCKED({
-			gpioMcuSetRegPart1(0, GPIO_WLAN_STATE); // not needed? will error
-			T(gpioMcuReadData(&wlan_state, GPIO_WLAN_STATE));
-		});
+		T(gpioMcuSnapshotWlan(&wlan_gpio));
 		T(mcuGetFirmFlag(&had_wireless_disabled, MCU_FIRMFLG_WIRELESS_DISABLED, LOCK));
 		
 		T(mcuUpdateFirmware(mcu_firm, sizeof mcu_firm, LOCK));
 		g_McuFirmWasUpdated = true;
 		
+		T(mcuTakeRegisterSnapshot());
+		
 		T(mcuSetLedState(MCUREG_WLAN_LED_STATE, wlan_led_state, LOCK));
-		T(gpioMcuWriteData_l(wlan_mode, GPIO_WLAN_MODE));
-		GPIO_LOCKED({
-			gpioMcuSetRegPart1(GPIO_WLAN_STATE, GPIO_WLAN_STATE); // not needed? will error
-			T(gpioMcuWriteData(wlan_state, GPIO_WLAN_STATE));
-		});
+		T(gpioMcuRestoreWlan(wlan_gpio));
 		
 		T(mcuSetFirmFlag(MCU_FIRMFLG_WIRELESS_DISABLED, had_wireless_disabled, LOCK));
 	}
 #endif
+	bootStage(MCU_BOOT_FIRMWARE_CHECKED);
 
-	if (signal_poweroff)
+	if (boot.signal_poweroff)
 		mcuHandleInterruptEvents(MCUINT_POWER_BUTTON_HELD);
 	
-	u8 battery_perc = 0;
-	T(mcuReadBatteryPercentageInt(&battery_perc, LOCK));
+	/* after a possible firmware update, so the page has the version that's actually running */
+	T(mcuInitStatusPage());
+	bootStage(MCU_BOOT_STATUS_PAGE_READY);
+	
+	/* first battery sample, the worker thread keeps it current from here on */
+	MCU_BatterySample battery = { 0 };
+	
+	T(mcuSampleBattery(LOCK));
+	mcuGetBatterySample(&battery);
 	
-	if (battery_perc == 0)
+	if ((battery.percentage >> 8) == 0)
 		mcuHandleInterruptEvents(MCUINT_CRITICAL_BATTERY);
 	
+	bootStage(MCU_BOOT_BATTERY_SAMPLED);
+	
+	// handles[11] - worker thread
+	T(startThread(&handles[11], &MCU_WorkerThreadMain, NULL, &MCU_ThreadStacks[11], 21, -2));
+	bootStage(MCU_BOOT_SERVING);
+	
 	while (true)
 	{
 		s32 index;
 
-		// (num_handles - 1) because we don't want to wait for irq thread to join here
-		Result res = svcWaitSynchronizationN(&index, handles, countof(handles) - 1, false, -1);
+		// (num_handles - 2) because we don't want to wait for the irq and worker threads to join here
+		Result res = svcWaitSynchronizationN(&index, handles, countof(handles) - 2, false, -1);
 
 		if (R_FAILED(res))
 			Err_Throw(res);
@@ -349,6 +560,12 @@ void MCU_Main()
 	
 	// wait and close irq handler thread
 	freeThread(&handles[10]);
+	
+	g_WorkerThreadExitFlag = true;
+	T(svcSignalEvent(g_WorkerEvent));
+	
+	// wait and close worker thread
+	freeThread(&handles[11]);
 
 	T(svcCloseHandle(handles[0]));
 
@@ -363,6 +580,11 @@ void MCU_Main()
 	T(svcCloseHandle(g_IRQEvents[EVENT_GPU]));
 	T(svcCloseHandle(g_IRQEvents[EVENT_HID]));
 	T(svcCloseHandle(g_IRQEvents[EVENT_POWER]));
+	T(svcCloseHandle(g_VolumeSliderEvent));
+	T(svcCloseHandle(g_BatteryEvent));
+	T(svcCloseHandle(g_WorkerEvent));
+	T(svcCloseHandle(g_LcdAckEvent));
+	mcuExitStatusPage();
 	gpioMcuExit();
 	i2cMcuExit();
 	srvExit();
@@ -0,0 +1,463 @@
+#include <3ds/synchronization.h>
+#include <mcu/globals.h>
+#include <3ds/result.h>
+#include <mcu/alarm.h>
+#include <mcu/timer.h>
+#include <3ds/err.h>
+#include <3ds/svc.h>
+#include <mcu/mcu.h>
+#include <memops.h>
+#include <util.h>
+
+/*
+	Software alarms multiplexed onto the single minute-granular MCU RTC alarm.
+	Every client alarm lives in one min-heap ordered by minutes since 2000, and
+	the earliest is what's programmed into MCUREG_RTC_ALARM_MINUTE..YEAR. When
+	MCUINT_RTC_ALARM fires, everything due is popped, the owners' events are
+	signalled and the next one is programmed. Only touched with g_I2CLock held,
+	like the RTC registers themselves.
+*/
+typedef struct RtcAlarmEntry {
+	void *owner;
+	u32 id;
+	u32 key; /* minutes since 2000 */
+	MCU_RtcAlarm time;
+} RtcAlarmEntry;
+
+static struct {
+	RtcAlarmEntry entries[RTC_ALARM_COUNT];
+	u8 heap[RTC_ALARM_COUNT]; /* entry indices */
+	u8 count;
+	u32 next_id;
+	u32 programmed_key;
+	struct {
+		void *owner;
+		Handle event;
+	} owners[RTC_ALARM_OWNER_COUNT];
+	MCU_RtcAlarm legacy;
+	u32 legacy_id;
+	bool legacy_pending; /* the legacy alarm came due outside of MCUINT_RTC_ALARM and still has to reach mcu::RTC */
+} s_Alarms;
+
+static inline u32 alarmKey(const MCU_RtcAlarm *time)
+{
+	return (daysSince2000(time->year, time->month, time->day) * 24 + time->hour) * 60 + time->minute;
+}
+
+static inline u32 heapKey(u32 position)
+{
+	return s_Alarms.entries[s_Alarms.heap[position]].key;
+}
+
+static inline void heapSwap(u32 a, u32 b)
+{
+	u8 tmp = s_Alarms.heap[a];
+	s_Alarms.heap[a] = s_Alarms.heap[b];
+	s_Alarms.heap[b] = tmp;
+}
+
+static void heapSiftUp(u32 position)
+{
+	while (position) {
+		u32 parent = (position - 1) >> 1;
+		
+		if (heapKey(parent) <= heapKey(position))
+			break;
+		
+		heapSwap(parent, position);
+		position = parent;
+	}
+}
+
+static void heapSiftDown(u32 position)
+{
+	while (true) {
+		u32 smallest = position;
+		u32 left = position * 2 + 1;
+		u32 right = left + 1;
+		
+		if (left < s_Alarms.count && heapKey(left) < heapKey(smallest))
+			smallest = left;
+		
+		if (right < s_Alarms.count && heapKey(right) < heapKey(smallest))
+			smallest = right;
+		
+		if (smallest == position)
+			break;
+		
+		heapSwap(smallest, position);
+		position = smallest;
+	}
+}
+
+/* frees the entry at a heap position, the entry slot goes back to being unused */
+static void heapRemove(u32 position)
+{
+	_memset32_aligned(&s_Alarms.entries[s_Alarms.heap[position]], 0, sizeof(RtcAlarmEntry));
+	
+	s_Alarms.count--;
+	
+	if (position == s_Alarms.count)
+		return;
+	
+	s_Alarms.heap[position] = s_Alarms.heap[s_Alarms.count];
+	heapSiftDown(position);
+	heapSiftUp(position);
+}
+
+static u32 heapFind(void *owner, u32 id)
+{
+	for (u32 i = 0; i < s_Alarms.count; i++) {
+		RtcAlarmEntry *entry = &s_Alarms.entries[s_Alarms.heap[i]];
+		
+		if (entry->id == id && entry->owner == owner)
+			return i;
+	}
+	
+	return RTC_ALARM_COUNT;
+}
+
+static Handle ownerEvent(void *owner)
+{
+	for (u32 i = 0; i < RTC_ALARM_OWNER_COUNT; i++)
+		if (s_Alarms.owners[i].owner == owner)
+			return s_Alarms.owners[i].event;
+	
+	return 0;
+}
+
+/* writes the earliest alarm into the MCU, a single 5 byte write, and only if it changed */
+static Result programEarliestAlarm()
+{
+	MCU_RtcAlarm disabled = { 0, 0, 0, 0, 0 };
+	MCU_RtcAlarm *time = s_Alarms.count ? &s_Alarms.entries[s_Alarms.heap[0]].time : &disabled;
+	u32 key = s_Alarms.count ? heapKey(0) : 0;
+	
+	if (key == s_Alarms.programmed_key)
+		return 0;
+	
+	Result res = mcuSetRtcAlarm(time, NOLOCK);
+	if (R_FAILED(res)) return res;
+	
+	s_Alarms.programmed_key = key;
+	return res;
+}
+
+static Result currentMinute(u32 *out_key)
+{
+	u32 seconds = 0;
+	
+	Result res = mcuGetRtcSeconds(&seconds, NOLOCK);
+	if (R_FAILED(res)) return res;
+	
+	*out_key = seconds / 60;
+	return res;
+}
+
+/* pops and signals everything due, returns whether the legacy alarm was among it */
+static bool fireDueAlarms(u32 now_key)
+{
+	bool legacy = false;
+	
+	while (s_Alarms.count && heapKey(0) <= now_key) {
+		RtcAlarmEntry *entry = &s_Alarms.entries[s_Alarms.heap[0]];
+		
+		if (entry->owner == RTC_ALARM_LEGACY_OWNER) {
+			legacy = true;
+			s_Alarms.legacy_id = 0;
+		} else if (entry->owner == RTC_ALARM_TIMER_OWNER) {
+			mcuResyncTimers(entry->id);
+		} else {
+			Handle event = ownerEvent(entry->owner);
+			
+			if (event)
+				T(svcSignalEvent(event));
+		}
+		
+		heapRemove(0);
+	}
+	
+	return legacy;
+}
+
+static Result addAlarm(void *owner, const MCU_RtcAlarm *alarm, u32 *out_id)
+{
+	if (s_Alarms.count == RTC_ALARM_COUNT)
+		return MCU_OUT_OF_SUBSCRIPTIONS;
+	
+	u32 index = 0;
+	
+	for (; index < RTC_ALARM_COUNT; index++)
+		if (!s_Alarms.entries[index].owner)
+			break;
+	
+	RtcAlarmEntry *entry = &s_Alarms.entries[index];
+	
+	/* ids are never 0, and never reused before wrapping around */
+	if (!++s_Alarms.next_id)
+		s_Alarms.next_id = 1;
+	
+	entry->owner = owner;
+	entry->id = s_Alarms.next_id;
+	entry->key = alarmKey(alarm);
+	_memcpy(&entry->time, alarm, sizeof(MCU_RtcAlarm));
+	
+	s_Alarms.heap[s_Alarms.count] = (u8)index;
+	heapSiftUp(s_Alarms.count++);
+	
+	*out_id = entry->id;
+	return 0;
+}
+
+/* anything that's already due fires now, since the MCU won't for a time in the past */
+static bool rearmAlarms()
+{
+	u32 now_key = 0;
+	bool legacy = false;
+	
+	if (R_SUCCEEDED(currentMinute(&now_key)))
+		legacy = fireDueAlarms(now_key);
+	
+	T(programEarliestAlarm());
+	
+	return legacy;
+}
+
+/* for everything but the IRQ, a legacy alarm that came due on the way is handed to deliverLegacyAlarm */
+static inline void rearmAlarmsOutsideIrq()
+{
+	if (rearmAlarms())
+		s_Alarms.legacy_pending = true;
+}
+
+/*
+	Sends a pending legacy alarm the same way MCUINT_RTC_ALARM would have gone:
+	queued while an exclusive IRQ lease is held, dispatched otherwise, with
+	mcuFireRtcAlarms letting it through. Called without g_I2CLock held, since the
+	IRQ path takes g_ExclusiveIRQLock first.
+*/
+static void deliverLegacyAlarm()
+{
+	RecursiveLock_Lock(&g_I2CLock);
+	bool pending = s_Alarms.legacy_pending;
+	RecursiveLock_Unlock(&g_I2CLock);
+	
+	if (!pending)
+		return;
+	
+	RecursiveLock_Lock(&g_ExclusiveIRQLock);
+	
+	if (!mcuQueueExclusiveIrqs(MCUINT_RTC_ALARM, svcGetSystemTick()))
+		mcuHandleInterruptEvents(MCUINT_RTC_ALARM);
+	
+	RecursiveLock_Unlock(&g_ExclusiveIRQLock);
+}
+
+static Result _mcuAddRtcAlarm(void *owner, const MCU_RtcAlarm *alarm, u32 *out_id, Handle *out_event)
+{
+	u32 slot = RTC_ALARM_OWNER_COUNT;
+	
+	for (u32 i = 0; i < RTC_ALARM_OWNER_COUNT; i++) {
+		if (s_Alarms.owners[i].owner == owner) {
+			slot = i;
+			break;
+		}
+		
+		if (!s_Alarms.owners[i].owner && slot == RTC_ALARM_OWNER_COUNT)
+			slot = i;
+	}
+	
+	if (slot == RTC_ALARM_OWNER_COUNT)
+		return MCU_OUT_OF_SUBSCRIPTIONS;
+	
+	if (!s_Alarms.owners[slot].owner) {
+		Result res = svcCreateEvent(&s_Alarms.owners[slot].event, RESET_ONESHOT);
+		if (R_FAILED(res)) return res;
+		
+		s_Alarms.owners[slot].owner = owner;
+	}
+	
+	Result res = addAlarm(owner, alarm, out_id);
+	if (R_FAILED(res)) return res;
+	
+	/* a past alarm signals right away */
+	rearmAlarmsOutsideIrq();
+	
+	*out_event = s_Alarms.owners[slot].event;
+	return res;
+}
+
+Result mcuAddRtcAlarm(void *owner, const MCU_RtcAlarm *alarm, u32 *out_id, Handle *out_event)
+{
+	Result res;
+	
+	I2C_LOCKED(
+		res = _mcuAddRtcAlarm(owner, alarm, out_id, out_event)
+	)
+	
+	deliverLegacyAlarm();
+	return res;
+}
+
+/* for alarms the module sets up for itself, these have no event and are given as minutes since 2000 */
+Result mcuAddInternalRtcAlarm(void *owner, u32 minute_key, u32 *out_id)
+{
+	MCU_RtcAlarm alarm;
+	u32 days = minute_key / (24 * 60);
+	u32 minutes = minute_key - days * (24 * 60);
+	
+	dateFromDaysSince2000(days, &alarm.year, &alarm.month, &alarm.day);
+	alarm.hour = (u8)(minutes / 60);
+	alarm.minute = (u8)(minutes - alarm.hour * 60);
+	
+	Result res;
+	
+	I2C_LOCKED(
+		res = addAlarm(owner, &alarm, out_id);
+		
+		if (R_SUCCEEDED(res))
+			rearmAlarmsOutsideIrq();
+	)
+	
+	deliverLegacyAlarm();
+	return res;
+}
+
+Result mcuCancelRtcAlarm(void *owner, u32 id)
+{
+	Result res = MCU_INVALID_TOKEN;
+	
+	RecursiveLock_Lock(&g_I2CLock);
+	
+	u32 position = heapFind(owner, id);
+	
+	if (position < RTC_ALARM_COUNT) {
+		heapRemove(position);
+		res = programEarliestAlarm();
+	}
+	
+	RecursiveLock_Unlock(&g_I2CLock);
+	
+	return res;
+}
+
+void mcuReleaseRtcAlarms(void *owner)
+{
+	RecursiveLock_Lock(&g_I2CLock);
+	
+	/* heapRemove can sift an entry into a position that was already checked, so start over after each one */
+	for (u32 i = 0; i < s_Alarms.count;) {
+		if (s_Alarms.entries[s_Alarms.heap[i]].owner == owner) {
+			heapRemove(i);
+			i = 0;
+		} else {
+			i++;
+		}
+	}
+	
+	for (u32 i = 0; i < RTC_ALARM_OWNER_COUNT; i++) {
+		if (s_Alarms.owners[i].owner == owner) {
+			T(svcCloseHandle(s_Alarms.owners[i].event));
+			s_Alarms.owners[i].owner = NULL;
+			s_Alarms.owners[i].event = 0;
+		}
+	}
+	
+	T(programEarliestAlarm());
+	
+	RecursiveLock_Unlock(&g_I2CLock);
+}
+
+/* MCUINT_RTC_ALARM handler, returns whether the IRQ should still reach mcu::RTC's power event */
+bool mcuFireRtcAlarms()
+{
+	bool legacy;
+	
+	I2C_LOCKED(
+		/* the hardware alarm is spent either way */
+		s_Alarms.programmed_key = U32_MAX;
+		legacy = rearmAlarms() || s_Alarms.legacy_pending;
+		s_Alarms.legacy_pending = false;
+	)
+	
+	return legacy;
+}
+
+static Result updateLegacyAlarm()
+{
+	if (s_Alarms.legacy_id) {
+		u32 position = heapFind(RTC_ALARM_LEGACY_OWNER, s_Alarms.legacy_id);
+		
+		if (position < RTC_ALARM_COUNT)
+			heapRemove(position);
+		
+		s_Alarms.legacy_id = 0;
+	}
+	
+	u32 now_key = 0;
+	bool enabled = s_Alarms.legacy.minute | s_Alarms.legacy.hour | s_Alarms.legacy.day | s_Alarms.legacy.month | s_Alarms.legacy.year;
+	bool past = R_SUCCEEDED(currentMinute(&now_key)) && alarmKey(&s_Alarms.legacy) <= now_key;
+	
+	/*
+		All zeroes is how the alarm gets disabled. A time that is already past is
+		dropped: the MCU never fires on a past match either, and RTC 0x0015-0x001E
+		write one field at a time, so a future alarm is usually in the past while
+		it's still being set. Only one that was accepted and then missed, like
+		one popped on a later re-arm, goes out to mcu::RTC.
+	*/
+	if (enabled && !past) {
+		Result res = addAlarm(RTC_ALARM_LEGACY_OWNER, &s_Alarms.legacy, &s_Alarms.legacy_id);
+		if (R_FAILED(res)) return res;
+	}
+	
+	rearmAlarmsOutsideIrq();
+	return 0;
+}
+
+Result mcuSetLegacyRtcAlarm(const MCU_RtcAlarm *alarm)
+{
+	RecursiveLock_Lock(&g_I2CLock);
+	
+	_memcpy(&s_Alarms.legacy, alarm, sizeof(MCU_RtcAlarm));
+	Result res = updateLegacyAlarm();
+	
+	RecursiveLock_Unlock(&g_I2CLock);
+	
+	deliverLegacyAlarm();
+	return res;
+}
+
+void mcuGetLegacyRtcAlarm(MCU_RtcAlarm *out_alarm)
+{
+	RecursiveLock_Lock(&g_I2CLock);
+	_memcpy(out_alarm, &s_Alarms.legacy, sizeof(MCU_RtcAlarm));
+	RecursiveLock_Unlock(&g_I2CLock);
+}
+
+Result mcuSetLegacyRtcAlarmField(u8 field_regid, u8 value)
+{
+	if (field_regid < MCUREG_RTC_ALARM_MINUTE || field_regid > MCUREG_RTC_ALARM_YEAR)
+		return MCU_OUT_OF_RANGE;
+	
+	RecursiveLock_Lock(&g_I2CLock);
+	
+	((u8 *)&s_Alarms.legacy)[field_regid - MCUREG_RTC_ALARM_MINUTE] = value;
+	Result res = updateLegacyAlarm();
+	
+	RecursiveLock_Unlock(&g_I2CLock);
+	
+	deliverLegacyAlarm();
+	return res;
+}
+
+u8 mcuGetLegacyRtcAlarmField(u8 field_regid)
+{
+	if (field_regid < MCUREG_RTC_ALARM_MINUTE || field_regid > MCUREG_RTC_ALARM_YEAR)
+		return 0;
+	
+	RecursiveLock_Lock(&g_I2CLock);
+	u8 value = ((u8 *)&s_Alarms.legacy)[field_regid - MCUREG_RTC_ALARM_MINUTE];
+	RecursiveLock_Unlock(&g_I2CLock);
+	
+	return value;
+}
@@ -0,0 +1,245 @@
+#include <3ds/synchronization.h>
+#include <mcu/globals.h>
+#include <mcu/battery.h>
+#include <mcu/status.h>
+#include <3ds/result.h>
+#include <3ds/err.h>
+#include <3ds/svc.h>
+#include <mcu/mcu.h>
+#include <memops.h>
+#include <util.h>
+
+/* written by the worker thread (and once at boot), read by the IPC threads, all under g_BatteryLock */
+static struct {
+	MCU_BatterySample history[BATTERY_HISTORY_COUNT];
+	u32 total;
+	u32 interval_ms;
+	s64 next_tick;
+	bool charging;
+} s_Battery;
+
+/*
+	Exponentially weighted rate of change of the percentage, plus the mean absolute
+	deviation from it for the confidence value. Rates are taken between anchor
+	samples at least BATTERY_ESTIMATE_MIN_SPAN_S apart, so the quantization of the
+	fractional percentage register doesn't dominate. The voltage is too coarse to
+	give a rate of its own, but a percentage step the voltage clearly moved
+	against is the fuel gauge recalibrating, not the battery, and is left out.
+*/
+#define BATTERY_EWMA_SHIFT       3 /* alpha = 1/8 */
+#define BATTERY_CONFIDENT_UPDATES 8
+#define BATTERY_VOLTAGE_NOISE    2 /* 40mV, less than that is register noise */
+
+static struct {
+	u32 anchor_seconds;
+	u16 anchor_percentage;
+	u8 anchor_voltage;
+	bool anchored;
+	u8 updates;
+	s32 rate;
+	u32 deviation;
+} s_BatteryEstimator;
+
+static void resetBatteryEstimator(const MCU_BatterySample *sample)
+{
+	s_BatteryEstimator.anchor_seconds = sample->seconds;
+	s_BatteryEstimator.anchor_percentage = sample->percentage;
+	s_BatteryEstimator.anchor_voltage = sample->voltage;
+	s_BatteryEstimator.anchored = true;
+	s_BatteryEstimator.updates = 0;
+	s_BatteryEstimator.rate = 0;
+	s_BatteryEstimator.deviation = 0;
+}
+
+static void updateBatteryEstimator(const MCU_BatterySample *sample)
+{
+	u32 span = sample->seconds - s_BatteryEstimator.anchor_seconds;
+	
+	if (span < BATTERY_ESTIMATE_MIN_SPAN_S)
+		return;
+	
+	s32 delta = (s32)sample->percentage - (s32)s_BatteryEstimator.anchor_percentage;
+	s32 voltage_delta = (s32)sample->voltage - (s32)s_BatteryEstimator.anchor_voltage;
+	
+	s_BatteryEstimator.anchor_seconds = sample->seconds;
+	s_BatteryEstimator.anchor_percentage = sample->percentage;
+	s_BatteryEstimator.anchor_voltage = sample->voltage;
+	
+	if ((delta < 0 && voltage_delta >= BATTERY_VOLTAGE_NOISE) || (delta > 0 && voltage_delta <= -BATTERY_VOLTAGE_NOISE))
+		return;
+	
+	u32 magnitude = udiv32((u32)(delta < 0 ? -delta : delta) * 256 * 60, span);
+	s32 rate = delta < 0 ? -(s32)magnitude : (s32)magnitude;
+	
+	if (!s_BatteryEstimator.updates) {
+		s_BatteryEstimator.rate = rate;
+	} else {
+		s32 error = rate - s_BatteryEstimator.rate;
+		
+		s_BatteryEstimator.rate += error >> BATTERY_EWMA_SHIFT;
+		s_BatteryEstimator.deviation += ((s32)(error < 0 ? -error : error) - (s32)s_BatteryEstimator.deviation) >> BATTERY_EWMA_SHIFT;
+	}
+	
+	if (s_BatteryEstimator.updates < BATTERY_CONFIDENT_UPDATES)
+		s_BatteryEstimator.updates++;
+}
+
+static inline MCU_BatterySample *latestBatterySample()
+{
+	return &s_Battery.history[(s_Battery.total - 1) & (BATTERY_HISTORY_COUNT - 1)];
+}
+
+Result mcuSampleBattery(bool lock)
+{
+	u8 data[6]; /* temperature, percentage (integer), percentage (fraction), voltage, unused, power status */
+	
+	Result res = lock ? mcuReadRegisterBuffer8_l(MCUREG_BATTERY_PCB_TEMPERATURE, data, sizeof(data))
+	                  : mcuReadRegisterBuffer8(MCUREG_BATTERY_PCB_TEMPERATURE, data, sizeof(data));
+	if (R_FAILED(res)) return res;
+	
+	s64 now = svcGetSystemTick();
+	bool changed = true;
+	
+	RecursiveLock_Lock(&g_BatteryLock);
+	
+	if (s_Battery.total) {
+		MCU_BatterySample *last = latestBatterySample();
+		
+		changed = (last->percentage >> 8) != data[1] ||
+		          last->temperature / BATTERY_TEMPERATURE_BAND != data[0] / BATTERY_TEMPERATURE_BAND;
+	}
+	
+	MCU_BatterySample *sample = &s_Battery.history[s_Battery.total & (BATTERY_HISTORY_COUNT - 1)];
+	
+	sample->seconds = TICKS_TO_S(now);
+	sample->percentage = (u16)(data[1] << 8 | data[2]);
+	sample->voltage = data[3];
+	sample->temperature = data[0];
+	
+	s_Battery.total++;
+	
+	mcuPublishBatterySample(sample, data[5]);
+	
+	/* charger plugged or unplugged, the old trend means nothing anymore */
+	bool charging = (data[5] & MCU_PWRSTAT_CHARGING) != 0;
+	
+	if (!s_BatteryEstimator.anchored || charging != s_Battery.charging) {
+		s_Battery.charging = charging;
+		resetBatteryEstimator(sample);
+	} else {
+		updateBatteryEstimator(sample);
+	}
+	
+	/* look more often while things are moving, back off while they are not */
+	if (!s_Battery.interval_ms)
+		s_Battery.interval_ms = BATTERY_SAMPLE_MIN_MS;
+	else if (changed)
+		s_Battery.interval_ms = MAX(s_Battery.interval_ms >> 1, BATTERY_SAMPLE_MIN_MS);
+	else
+		s_Battery.interval_ms = MIN(s_Battery.interval_ms << 1, BATTERY_SAMPLE_MAX_MS);
+	
+	s_Battery.next_tick = now + MS_TO_TICKS(s_Battery.interval_ms);
+	
+	RecursiveLock_Unlock(&g_BatteryLock);
+	
+	if (changed)
+		T(svcSignalEvent(g_BatteryEvent));
+	
+	return res;
+}
+
+void mcuGetBatterySample(MCU_BatterySample *out_sample)
+{
+	RecursiveLock_Lock(&g_BatteryLock);
+	_memcpy32_aligned(out_sample, latestBatterySample(), sizeof(MCU_BatterySample));
+	RecursiveLock_Unlock(&g_BatteryLock);
+}
+
+u32 mcuGetBatteryHistory(MCU_BatterySample *out_samples, u32 max_samples, u32 *out_total)
+{
+	RecursiveLock_Lock(&g_BatteryLock);
+	
+	u32 count = MIN(MIN(s_Battery.total, BATTERY_HISTORY_COUNT), max_samples);
+	u32 first = s_Battery.total - count;
+	
+	/* oldest first */
+	for (u32 i = 0; i < count; i++)
+		_memcpy(&out_samples[i], &s_Battery.history[(first + i) & (BATTERY_HISTORY_COUNT - 1)], sizeof(MCU_BatterySample));
+	
+	*out_total = s_Battery.total;
+	
+	RecursiveLock_Unlock(&g_BatteryLock);
+	
+	return count;
+}
+
+void mcuGetBatteryEstimate(MCU_BatteryEstimate *out_estimate)
+{
+	_memset32_aligned(out_estimate, 0, sizeof(MCU_BatteryEstimate));
+	
+	RecursiveLock_Lock(&g_BatteryLock);
+	
+	u32 percentage = latestBatterySample()->percentage;
+	s32 rate = s_BatteryEstimator.rate;
+	u32 deviation = s_BatteryEstimator.deviation;
+	u32 updates = s_BatteryEstimator.updates;
+	bool charging = s_Battery.charging;
+	
+	RecursiveLock_Unlock(&g_BatteryLock);
+	
+	out_estimate->rate = rate;
+	out_estimate->charging = charging;
+	out_estimate->minutes = BATTERY_ESTIMATE_UNKNOWN;
+	
+	/* only a trend pointing the way the charger says is usable */
+	u32 magnitude = charging ? (rate > 0 ? (u32)rate : 0) : (rate < 0 ? (u32)-rate : 0);
+	
+	/* more than the whole battery per minute is a glitch, not a trend */
+	if (!updates || !magnitude || magnitude > (100 << 16))
+		return;
+	
+	/* percentage is 8.8, rate is 16.16 per minute */
+	u32 remaining = charging ? (percentage < (100 << 8) ? (100 << 8) - percentage : 0) : percentage;
+	
+	out_estimate->minutes = udiv32(remaining << 8, magnitude);
+	
+	/* ramps up with the number of rates seen, scaled down by how noisy they were */
+	u32 confidence = updates * 100 / BATTERY_CONFIDENT_UPDATES;
+	
+	if (deviation >= magnitude)
+		confidence = 0;
+	else
+		confidence = udiv32(confidence * (magnitude - deviation), magnitude);
+	
+	out_estimate->confidence = (u8)confidence;
+}
+
+/* charger state changed, sample as soon as the worker thread gets to it */
+void mcuRequestBatterySample()
+{
+	RecursiveLock_Lock(&g_BatteryLock);
+	s_Battery.interval_ms = BATTERY_SAMPLE_MIN_MS;
+	s_Battery.next_tick = 0;
+	RecursiveLock_Unlock(&g_BatteryLock);
+	
+	T(svcSignalEvent(g_WorkerEvent));
+}
+
+/* samples if due, returns the tick the next sample is due at */
+s64 mcuRunBatterySampler(s64 now)
+{
+	RecursiveLock_Lock(&g_BatteryLock);
+	s64 next_tick = s_Battery.next_tick;
+	RecursiveLock_Unlock(&g_BatteryLock);
+	
+	if (now < next_tick)
+		return next_tick;
+	
+	T(mcuSampleBattery(LOCK));
+	
+	RecursiveLock_Lock(&g_BatteryLock);
+	next_tick = s_Battery.next_tick;
+	RecursiveLock_Unlock(&g_BatteryLock);
+	
+	return next_tick;
+}
@@ -0,0 +1,193 @@
+#include <3ds/synchronization.h>
+#include <mcu/coalesce.h>
+#include <mcu/globals.h>
+#include <3ds/result.h>
+#include <3ds/err.h>
+#include <3ds/svc.h>
+#include <mcu/mcu.h>
+#include <util.h>
+
+/*
+	Optional write coalescing for the LED state registers that clients like to
+	toggle many times a second. With a window set for a register, a write only
+	lands in RAM and the worker thread sends whatever the latest value is once
+	the window since the first held write is over, so a client toggling
+	constantly still gets through at the window's rate. Reads see the held
+	value. Under g_I2CLock, like the registers themselves.
+*/
+#define COALESCED_REG_COUNT 5
+
+static const u8 s_CoalescedRegs[COALESCED_REG_COUNT] = {
+	MCUREG_CAMERA_LED_STATE,
+	MCUREG_3D_LED_STATE,
+	MCUREG_WLAN_LED_STATE,
+	MCUREG_POWER_LED_STATE,
+	MCUREG_LED_BRIGHTNESS_STATE,
+};
+
+static struct {
+	u32 window_ms; /* 0 writes straight through */
+	bool pending;
+	u8 value;
+	s64 deadline;
+} s_Coalesced[COALESCED_REG_COUNT];
+
+static s32 slotIndex(u8 led_regid)
+{
+	for (u32 i = 0; i < COALESCED_REG_COUNT; i++)
+		if (s_CoalescedRegs[i] == led_regid)
+			return i;
+	
+	return -1;
+}
+
+/* the power LED goes through its own cache in mcu.c */
+static inline Result writeLed(u8 led_regid, u8 state)
+{
+	return led_regid == MCUREG_POWER_LED_STATE ? mcuSetPowerLedState(state, NOLOCK) : mcuSetLedState(led_regid, state, NOLOCK);
+}
+
+static Result flushSlot(u32 index)
+{
+	Result res = writeLed(s_CoalescedRegs[index], s_Coalesced[index].value);
+	
+	/* keep holding it on failure, the next window tries again */
+	if (R_SUCCEEDED(res))
+		s_Coalesced[index].pending = false;
+	
+	return res;
+}
+
+Result mcuSetLedStateCoalesced(u8 led_regid, u8 state)
+{
+	s32 index = slotIndex(led_regid);
+	bool signal = false;
+	Result res = 0;
+	
+	I2C_LOCKED(
+		if (index < 0 || !s_Coalesced[index].window_ms) {
+			res = writeLed(led_regid, state);
+			
+			/* a straight write also supersedes anything still held */
+			if (index >= 0 && R_SUCCEEDED(res))
+				s_Coalesced[index].pending = false;
+		} else {
+			if (!s_Coalesced[index].pending) {
+				s_Coalesced[index].pending = true;
+				s_Coalesced[index].deadline = svcGetSystemTick() + MS_TO_TICKS(s_Coalesced[index].window_ms);
+				signal = true;
+			}
+			
+			s_Coalesced[index].value = state;
+		}
+	)
+	
+	/* have the worker thread pick up the deadline */
+	if (signal)
+		T(svcSignalEvent(g_WorkerEvent));
+	
+	return res;
+}
+
+Result mcuGetLedStateCoalesced(u8 led_regid, u8 *out_state)
+{
+	s32 index = slotIndex(led_regid);
+	Result res = 0;
+	
+	I2C_LOCKED(
+		if (index >= 0 && s_Coalesced[index].pending)
+			*out_state = s_Coalesced[index].value;
+		else if (led_regid == MCUREG_POWER_LED_STATE)
+			res = mcuGetPowerLedState(out_state, NOLOCK);
+		else
+			res = mcuGetLedState(led_regid, out_state, NOLOCK);
+	)
+	
+	return res;
+}
+
+Result mcuSetCoalesceWindow(u8 led_regid, u32 window_ms)
+{
+	s32 index = slotIndex(led_regid);
+	Result res = 0;
+	
+	if (index < 0 || window_ms > COALESCE_WINDOW_MAX_MS)
+		return MCU_OUT_OF_RANGE;
+	
+	I2C_LOCKED(
+		s_Coalesced[index].window_ms = window_ms;
+		
+		/* turning it off must not strand a held value */
+		if (!window_ms && s_Coalesced[index].pending)
+			res = flushSlot(index);
+	)
+	
+	return res;
+}
+
+/* sends the register's held value right away, for writes that build on what the MCU has */
+Result mcuFlushCoalescedWrite(u8 led_regid)
+{
+	s32 index = slotIndex(led_regid);
+	Result res = 0;
+	
+	I2C_LOCKED(
+		if (index >= 0 && s_Coalesced[index].pending)
+			res = flushSlot(index);
+	)
+	
+	return res;
+}
+
+/* forgets the register's held value, for writes that supersede it */
+void mcuDropCoalescedWrite(u8 led_regid)
+{
+	s32 index = slotIndex(led_regid);
+	
+	if (index < 0)
+		return;
+	
+	I2C_LOCKED(
+		s_Coalesced[index].pending = false;
+	)
+}
+
+/* sends everything held right away, for the shutdown and sleep paths */
+Result mcuFlushCoalescedWrites()
+{
+	Result res = 0;
+	
+	I2C_LOCKED(
+		for (u32 i = 0; i < COALESCED_REG_COUNT; i++) {
+			if (s_Coalesced[i].pending) {
+				Result flush_res = flushSlot(i);
+				
+				if (R_SUCCEEDED(res))
+					res = flush_res;
+			}
+		}
+	)
+	
+	return res;
+}
+
+/* sends what's due, returns the nearest deadline left, 0 if there is none */
+s64 mcuRunCoalescedWrites(s64 now)
+{
+	s64 next = 0;
+	
+	I2C_LOCKED(
+		for (u32 i = 0; i < COALESCED_REG_COUNT; i++) {
+			if (!s_Coalesced[i].pending)
+				continue;
+			
+			if (now >= s_Coalesced[i].deadline && R_FAILED(flushSlot(i)))
+				s_Coalesced[i].deadline = now + MS_TO_TICKS(s_Coalesced[i].window_ms);
+			
+			if (s_Coalesced[i].pending && (!next || s_Coalesced[i].deadline < next))
+				next = s_Coalesced[i].deadline;
+		}
+	)
+	
+	return next;
+}
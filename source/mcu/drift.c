@@ -0,0 +1,256 @@
+#include <3ds/synchronization.h>
+#include <mcu/globals.h>
+#include <3ds/result.h>
+#include <mcu/drift.h>
+#include <3ds/err.h>
+#include <3ds/svc.h>
+#include <mcu/mcu.h>
+#include <memops.h>
+#include <util.h>
+
+/* the poll for a second rollover starts this long before it is expected, polling every RTC_DRIFT_POLL_MS */
+#define RTC_DRIFT_GUARD_MS 150
+#define RTC_DRIFT_POLL_MS  2
+#define RTC_DRIFT_MAX_POLLS 600
+
+/*
+	RTC drift against the system tick. Every RTC_DRIFT_INTERVAL_S the worker
+	thread polls the seconds register around the expected rollover and records
+	the tick it changed at. For each sample, the residual r = elapsed ticks -
+	elapsed RTC seconds * SYSCLOCK_ARM11 (converted to microseconds) grows
+	linearly with the RTC seconds, and the least squares slope of that line is
+	the drift in ppm. The system tick is taken as the reference. Under
+	g_RtcDriftLock.
+*/
+static struct {
+	struct {
+		s64 tick;
+		u32 seconds;
+	} samples[RTC_DRIFT_SAMPLE_COUNT];
+	u32 total;
+	u32 first; /* samples before this belong to an older window */
+	
+	/* rollover poll in progress */
+	bool polling;
+	u8 poll_second;
+	u32 poll_seconds;
+	u32 polls;
+	s64 next_tick;
+	
+	bool auto_apply;
+	MCU_RtcDriftEstimate estimate;
+} s_Drift;
+
+/* fit scratch space, too big for the thread stacks */
+static struct {
+	s64 y[RTC_DRIFT_SAMPLE_COUNT];
+	s64 r[RTC_DRIFT_SAMPLE_COUNT];
+} s_DriftFit;
+
+static inline u32 driftSampleCount()
+{
+	return MIN(s_Drift.total - s_Drift.first, RTC_DRIFT_SAMPLE_COUNT);
+}
+
+static s32 correctionToPpm(u8 correction)
+{
+	s32 offset = (s8)(correction << 1) >> 1; /* sign extend the 7 bit offset */
+	
+	return offset * ((correction & 0x80) ? RTC_CORRECTION_STEP_60S_Q8 : RTC_CORRECTION_STEP_20S_Q8);
+}
+
+static u8 ppmToCorrection(s32 ppm)
+{
+	/* the finer 60 second mode as long as it has the range */
+	bool fine = ppm <= 63 * RTC_CORRECTION_STEP_60S_Q8 && ppm >= -63 * RTC_CORRECTION_STEP_60S_Q8;
+	u32 magnitude = ppm >= 0 ? (u32)ppm : (u32)-ppm;
+	
+	/* one constant divisor per mode, a runtime one would need __aeabi_idiv */
+	u32 steps;
+	
+	if (fine)
+		steps = (magnitude + RTC_CORRECTION_STEP_60S_Q8 / 2) / RTC_CORRECTION_STEP_60S_Q8;
+	else
+		steps = (magnitude + RTC_CORRECTION_STEP_20S_Q8 / 2) / RTC_CORRECTION_STEP_20S_Q8;
+	
+	steps = MIN(steps, 63u);
+	
+	s32 offset = ppm >= 0 ? (s32)steps : -(s32)steps;
+	
+	return (u8)(offset & 0x7F) | (fine ? 0x80 : 0);
+}
+
+static void fitDrift()
+{
+	MCU_RtcDriftEstimate *estimate = &s_Drift.estimate;
+	u32 count = driftSampleCount();
+	u32 oldest = s_Drift.total - count;
+	
+	estimate->samples = (u8)count;
+	estimate->drift_ppm = 0;
+	estimate->residual_us = 0;
+	estimate->span_s = 0;
+	estimate->recommended = estimate->current;
+	
+	if (count < 2)
+		return;
+	
+	s64 origin_tick = s_Drift.samples[oldest & (RTC_DRIFT_SAMPLE_COUNT - 1)].tick;
+	u32 origin_seconds = s_Drift.samples[oldest & (RTC_DRIFT_SAMPLE_COUNT - 1)].seconds;
+	s64 *y = s_DriftFit.y, *r = s_DriftFit.r;
+	s64 sy = 0, syy = 0, sr = 0, sry = 0;
+	
+	for (u32 i = 0; i < count; i++) {
+		u32 index = (oldest + i) & (RTC_DRIFT_SAMPLE_COUNT - 1);
+		
+		y[i] = s_Drift.samples[index].seconds - origin_seconds;
+		s64 residual_ticks = (s_Drift.samples[index].tick - origin_tick) - y[i] * SYSCLOCK_ARM11;
+		r[i] = sdiv64(residual_ticks * 1000000, SYSCLOCK_ARM11);
+		
+		sy += y[i];
+		syy += y[i] * y[i];
+		sr += r[i];
+		sry += r[i] * y[i];
+	}
+	
+	s64 n = count;
+	s64 den = n * syy - sy * sy;
+	
+	if (den <= 0)
+		return;
+	
+	/* microseconds of tick per RTC second is ppm, the tick running ahead means the RTC is slow */
+	s64 slope_q8 = sdiv64((n * sry - sy * sr) << 8, den);
+	s64 intercept = sdiv64(sr - sdiv64(slope_q8 * sy, 256), n);
+	u64 error = 0;
+	
+	for (u32 i = 0; i < count; i++) {
+		s64 e = r[i] - intercept - sdiv64(slope_q8 * y[i], 256);
+		error += e < 0 ? -e : e;
+	}
+	
+	estimate->drift_ppm = (s32)-slope_q8;
+	estimate->residual_us = (u32)udiv64(error, count);
+	estimate->span_s = (u32)y[count - 1];
+	
+	/* the drift was measured with the current correction already applied */
+	if (count >= RTC_DRIFT_MIN_SAMPLES)
+		estimate->recommended = ppmToCorrection(correctionToPpm(estimate->current) + estimate->drift_ppm);
+}
+
+static void addDriftSample(s64 tick, u32 seconds)
+{
+	/* a jump against the previous sample means the RTC was set, the old window is meaningless */
+	if (s_Drift.total != s_Drift.first) {
+		u32 prev = (s_Drift.total - 1) & (RTC_DRIFT_SAMPLE_COUNT - 1);
+		u32 expected = s_Drift.samples[prev].seconds + (u32)udiv64(tick - s_Drift.samples[prev].tick + SYSCLOCK_ARM11 / 2, SYSCLOCK_ARM11);
+		
+		if (seconds + 1 < expected || seconds > expected + 1)
+			s_Drift.first = s_Drift.total;
+	}
+	
+	u32 index = s_Drift.total & (RTC_DRIFT_SAMPLE_COUNT - 1);
+	
+	s_Drift.samples[index].tick = tick;
+	s_Drift.samples[index].seconds = seconds;
+	s_Drift.total++;
+	
+	u8 current = 0;
+	
+	if (R_SUCCEEDED(mcuGetRtcTimeCorrection(&current, LOCK)))
+		s_Drift.estimate.current = current;
+	
+	fitDrift();
+	
+	MCU_RtcDriftEstimate *estimate = &s_Drift.estimate;
+	
+	if (s_Drift.auto_apply && estimate->samples >= RTC_DRIFT_MIN_SAMPLES &&
+	    estimate->residual_us <= RTC_DRIFT_MAX_RESIDUAL_US && estimate->recommended != estimate->current) {
+		if (R_SUCCEEDED(mcuSetRtcTimeCorrection(estimate->recommended, LOCK))) {
+			/* what comes next is measured against the new correction */
+			estimate->current = estimate->recommended;
+			s_Drift.first = s_Drift.total;
+		}
+	}
+}
+
+static s64 _mcuRunRtcDriftEstimator(s64 now)
+{
+	if (!s_Drift.polling) {
+		if (now < s_Drift.next_tick)
+			return s_Drift.next_tick;
+		
+		MCU_ClockSnapshot snapshot;
+		
+		if (R_FAILED(mcuReadClockSnapshot(&snapshot, LOCK))) {
+			s_Drift.next_tick = now + MS_TO_TICKS(RTC_DRIFT_INTERVAL_S * 1000);
+			return s_Drift.next_tick;
+		}
+		
+		/* both from the same read, so the second always matches the full count */
+		s_Drift.poll_seconds = mcuRtcSeconds(&snapshot.time);
+		s_Drift.poll_second = snapshot.time.second;
+		
+		s_Drift.polling = true;
+		s_Drift.polls = 0;
+		return now + MS_TO_TICKS(RTC_DRIFT_POLL_MS);
+	}
+	
+	u8 second = 0;
+	
+	if (R_FAILED(mcuGetRtcTimeField(MCUREG_RTC_TIME_SECOND, &second, LOCK)) || ++s_Drift.polls >= RTC_DRIFT_MAX_POLLS) {
+		s_Drift.polling = false;
+		s_Drift.next_tick = now + MS_TO_TICKS(RTC_DRIFT_INTERVAL_S * 1000);
+		return s_Drift.next_tick;
+	}
+	
+	if (second == s_Drift.poll_second)
+		return now + MS_TO_TICKS(RTC_DRIFT_POLL_MS);
+	
+	/* rolled over just now, the seconds count from the first read carries on from there */
+	u32 seconds = s_Drift.poll_seconds - s_Drift.poll_second + second + (second < s_Drift.poll_second ? 60 : 0);
+	
+	s_Drift.polling = false;
+	addDriftSample(now, seconds);
+	
+	s_Drift.next_tick = now + MS_TO_TICKS(RTC_DRIFT_INTERVAL_S * 1000 - RTC_DRIFT_GUARD_MS);
+	return s_Drift.next_tick;
+}
+
+/* samples if due, returns when it wants to run next */
+s64 mcuRunRtcDriftEstimator(s64 now)
+{
+	RecursiveLock_Lock(&g_RtcDriftLock);
+	s64 next_tick = _mcuRunRtcDriftEstimator(now);
+	RecursiveLock_Unlock(&g_RtcDriftLock);
+	
+	return next_tick;
+}
+
+void mcuGetRtcDriftEstimate(MCU_RtcDriftEstimate *out_estimate)
+{
+	RecursiveLock_Lock(&g_RtcDriftLock);
+	
+	s_Drift.estimate.auto_apply = s_Drift.auto_apply;
+	_memcpy32_aligned(out_estimate, &s_Drift.estimate, sizeof(MCU_RtcDriftEstimate));
+	
+	RecursiveLock_Unlock(&g_RtcDriftLock);
+}
+
+void mcuSetRtcDriftAutoApply(bool enabled)
+{
+	RecursiveLock_Lock(&g_RtcDriftLock);
+	s_Drift.auto_apply = enabled;
+	RecursiveLock_Unlock(&g_RtcDriftLock);
+}
+
+/* the correction or the time was changed from outside, start a new window */
+void mcuResetRtcDrift()
+{
+	RecursiveLock_Lock(&g_RtcDriftLock);
+	
+	s_Drift.first = s_Drift.total;
+	fitDrift();
+	
+	RecursiveLock_Unlock(&g_RtcDriftLock);
+}
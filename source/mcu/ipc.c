@@ -3,7 +3,19 @@
 #include <3ds/err.h>
 
 
+#include <mcu/pedometer.h>
+#include <mcu/snapshot.h>
+#include <mcu/status.h>
+#include <mcu/coalesce.h>
+#include <mcu/powerled.h>
+#include <mcu/notifled.h>
 #include <mcu/globals.h>
+#include <mcu/drift.h>
+#include <mcu/timer.h>
+#include <mcu/watch.h>
+#include <mcu/alarm.h>
+#include <mcu/battery.h>
+#include <mcu/trace.h>
 #include <mcu/mcu.h>
 #include <mcu/ipc.h>
 #include <util.h>
@@ -82,7 +94,7 @@ void MCUCAM_HandleIPC()
 			CHECK_HEADER(0x0001, 1, 0);
 			
 			u8 state = (u8)cmdbuf[1] & 0xFF;
-			Result res = mcuSetLedState(MCUREG_CAMERA_LED_STATE, state, LOCK);
+			Result res = mcuSetLedStateCoalesced(MCUREG_CAMERA_LED_STATE, state);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x0001, 1, 0);
 			cmdbuf[1] = res;
@@ -93,13 +105,23 @@ void MCUCAM_HandleIPC()
 			CHECK_HEADER(0x0002, 0, 0);
 			
 			u8 state = 0;
-			Result res = mcuGetLedState(MCUREG_CAMERA_LED_STATE, &state, LOCK);
+			Result res = mcuGetLedStateCoalesced(MCUREG_CAMERA_LED_STATE, &state);
 
 			cmdbuf[0] = IPC_MakeHeader(0x0002, 2, 0);
 			cmdbuf[1] = res;
 			cmdbuf[2] = (u32)state;
 		}
 		break;
+	case 0x0003: // get status page memory block handle (read-only, MCU_StatusPage)
+		{
+			CHECK_HEADER(0x0003, 0, 0);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0003, 1, 2);
+			cmdbuf[1] = 0;
+			cmdbuf[2] = IPC_Desc_SharedHandles(1);
+			cmdbuf[3] = mcuGetStatusPageBlock();
+		}
+		break;
 	default:
 		RET_OS_INVALID_IPCARG;
 	}
@@ -246,7 +268,7 @@ void MCUGPU_HandleIPC()
 			
 			u8 state = (u8)cmdbuf[1] & 0xFF;
 			
-			Result res = mcuSetLedState(MCUREG_3D_LED_STATE, state, LOCK);
+			Result res = mcuSetLedStateCoalesced(MCUREG_3D_LED_STATE, state);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x000B, 1, 0);
 			cmdbuf[1] = res;
@@ -258,7 +280,7 @@ void MCUGPU_HandleIPC()
 			
 			u8 state = 0;
 			
-			Result res = mcuGetLedState(MCUREG_3D_LED_STATE, &state, LOCK);
+			Result res = mcuGetLedStateCoalesced(MCUREG_3D_LED_STATE, &state);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x000C, 2, 0);
 			cmdbuf[1] = res;
@@ -287,6 +309,35 @@ void MCUGPU_HandleIPC()
 			cmdbuf[2] = events;
 		}
 		break;
+	case 0x000F: // set LCD power and both backlights at once, wait for the acknowledgements (timeout in milliseconds, at most 2000), returns acknowledged IRQs and latency in microseconds
+		{
+			CHECK_HEADER(0x000F, 4, 0);
+			
+			bool lcd_on = (cmdbuf[1] & 0xFF) != 0;
+			bool top_bl_on = (cmdbuf[2] & 0xFF) != 0;
+			bool bot_bl_on = (cmdbuf[3] & 0xFF) != 0;
+			u32 timeout_ms = cmdbuf[4];
+			
+			u32 acked_irqs = 0, latency_us = 0;
+			
+			Result res = mcuSequenceLcdPower(lcd_on, top_bl_on, bot_bl_on, timeout_ms, &acked_irqs, &latency_us);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x000F, 3, 0);
+			cmdbuf[1] = res;
+			cmdbuf[2] = acked_irqs;
+			cmdbuf[3] = latency_us;
+		}
+		break;
+	case 0x0010: // get status page memory block handle (read-only, MCU_StatusPage)
+		{
+			CHECK_HEADER(0x0010, 0, 0);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0010, 1, 2);
+			cmdbuf[1] = 0;
+			cmdbuf[2] = IPC_Desc_SharedHandles(1);
+			cmdbuf[3] = mcuGetStatusPageBlock();
+		}
+		break;
 	default:
 		RET_OS_INVALID_IPCARG;
 	}
@@ -493,6 +544,28 @@ void MCUHID_HandleIPC()
 			cmdbuf[1] = 0;
 		}
 		break;
+	case 0x0010: // read input frame (sliders and accelerometer), reusing the last one if younger than the given age (in microseconds)
+		{
+			CHECK_HEADER(0x0010, 1, 0)
+			
+			u32 max_age_us = cmdbuf[1];
+			
+			Result res = mcuReadHidFrame((MCU_HidFrame *)(&cmdbuf[2]), US_TO_TICKS(max_age_us), LOCK);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0010, 1 + sizeof(MCU_HidFrame) / sizeof(u32), 0);
+			cmdbuf[1] = res;
+		}
+		break;
+	case 0x0011: // get status page memory block handle (read-only, MCU_StatusPage)
+		{
+			CHECK_HEADER(0x0011, 0, 0);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0011, 1, 2);
+			cmdbuf[1] = 0;
+			cmdbuf[2] = IPC_Desc_SharedHandles(1);
+			cmdbuf[3] = mcuGetStatusPageBlock();
+		}
+		break;
 	default:
 		RET_OS_INVALID_IPCARG;
 	}
@@ -524,16 +597,14 @@ void MCURTC_HandleIPC()
 		{
 			CHECK_HEADER(0x0002, 0, 0)
 			
-			MCU_RtcData data = { 0 };
-			s64 systick = 0;
+			MCU_ClockSnapshot snapshot = { 0 };
 			
-			Result res = mcuGetRtcTime(&data, LOCK);
-			systick = svcGetSystemTick();
+			Result res = mcuReadClockSnapshot(&snapshot, LOCK);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x0002, 5, 0);
 			cmdbuf[1] = res;
-			_memcpy(&cmdbuf[2], &data, sizeof(MCU_RtcData));
-			*(s64 *)(&cmdbuf[4]) = systick;
+			_memcpy(&cmdbuf[2], &snapshot.time, sizeof(MCU_RtcData));
+			*(s64 *)(&cmdbuf[4]) = snapshot.tick;
 		}
 		break;
 	case 0x0003: // set RTC time (second part)
@@ -740,6 +811,8 @@ void MCURTC_HandleIPC()
 			
 			Result res = mcuSetRtcTimeCorrection(correction_data, LOCK);
 			
+			mcuResetRtcDrift();
+			
 			cmdbuf[0] = IPC_MakeHeader(0x0011, 1, 0);
 			cmdbuf[1] = res;
 		}
@@ -765,7 +838,8 @@ void MCURTC_HandleIPC()
 			
 			_memcpy(&data, &cmdbuf[1], sizeof(MCU_RtcAlarm));
 			
-			Result res = mcuSetRtcAlarm(&data, LOCK);
+			/* just one of the scheduled alarms now, see mcu::RTC 0x0066 */
+			Result res = mcuSetLegacyRtcAlarm(&data);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x0013, 1, 0);
 			cmdbuf[1] = res;
@@ -777,10 +851,10 @@ void MCURTC_HandleIPC()
 			
 			MCU_RtcAlarm data = { 0 };
 			
-			Result res = mcuGetRtcAlarm(&data, LOCK);
+			mcuGetLegacyRtcAlarm(&data);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x0014, 3, 0);
-			cmdbuf[1] = res;
+			cmdbuf[1] = 0;
 			_memcpy(&cmdbuf[2], &data, sizeof(MCU_RtcAlarm));
 		}
 		break;
@@ -790,7 +864,7 @@ void MCURTC_HandleIPC()
 			
 			u8 minute = (u8)cmdbuf[1] & 0xFF;
 			
-			Result res = mcuSetRtcAlarmField(MCUREG_RTC_ALARM_MINUTE, minute, LOCK);
+			Result res = mcuSetLegacyRtcAlarmField(MCUREG_RTC_ALARM_MINUTE, minute);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x0015, 1, 0);
 			cmdbuf[1] = res;
@@ -802,10 +876,10 @@ void MCURTC_HandleIPC()
 			
 			u8 minute = 0;
 			
-			Result res = mcuGetRtcAlarmField(MCUREG_RTC_ALARM_MINUTE, &minute, LOCK);
+			minute = mcuGetLegacyRtcAlarmField(MCUREG_RTC_ALARM_MINUTE);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x0016, 2, 0);
-			cmdbuf[1] = res;
+			cmdbuf[1] = 0;
 			cmdbuf[2] = (u32)minute;
 		}
 		break;
@@ -815,7 +889,7 @@ void MCURTC_HandleIPC()
 			
 			u8 hour = (u8)cmdbuf[1] & 0xFF;
 			
-			Result res = mcuSetRtcAlarmField(MCUREG_RTC_ALARM_HOUR, hour, LOCK);
+			Result res = mcuSetLegacyRtcAlarmField(MCUREG_RTC_ALARM_HOUR, hour);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x0017, 1, 0);
 			cmdbuf[1] = res;
@@ -827,10 +901,10 @@ void MCURTC_HandleIPC()
 			
 			u8 hour = 0;
 			
-			Result res = mcuGetRtcAlarmField(MCUREG_RTC_ALARM_HOUR, &hour, LOCK);
+			hour = mcuGetLegacyRtcAlarmField(MCUREG_RTC_ALARM_HOUR);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x0018, 2, 0);
-			cmdbuf[1] = res;
+			cmdbuf[1] = 0;
 			cmdbuf[2] = (u32)hour;
 		}
 		break;
@@ -840,7 +914,7 @@ void MCURTC_HandleIPC()
 			
 			u8 day = (u8)cmdbuf[1] & 0xFF;
 			
-			Result res = mcuSetRtcAlarmField(MCUREG_RTC_ALARM_DAY, day, LOCK);
+			Result res = mcuSetLegacyRtcAlarmField(MCUREG_RTC_ALARM_DAY, day);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x0019, 1, 0);
 			cmdbuf[1] = res;
@@ -852,10 +926,10 @@ void MCURTC_HandleIPC()
 			
 			u8 day = 0;
 			
-			Result res = mcuGetRtcAlarmField(MCUREG_RTC_ALARM_DAY, &day, LOCK);
+			day = mcuGetLegacyRtcAlarmField(MCUREG_RTC_ALARM_DAY);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x001A, 2, 0);
-			cmdbuf[1] = res;
+			cmdbuf[1] = 0;
 			cmdbuf[2] = (u32)day;
 		}
 		break;
@@ -865,7 +939,7 @@ void MCURTC_HandleIPC()
 			
 			u8 month = (u8)cmdbuf[1] & 0xFF;
 			
-			Result res = mcuSetRtcAlarmField(MCUREG_RTC_ALARM_MONTH, month, LOCK);
+			Result res = mcuSetLegacyRtcAlarmField(MCUREG_RTC_ALARM_MONTH, month);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x001B, 1, 0);
 			cmdbuf[1] = res;
@@ -877,10 +951,10 @@ void MCURTC_HandleIPC()
 			
 			u8 month = 0;
 			
-			Result res = mcuGetRtcAlarmField(MCUREG_RTC_ALARM_MONTH, &month, LOCK);
+			month = mcuGetLegacyRtcAlarmField(MCUREG_RTC_ALARM_MONTH);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x001C, 2, 0);
-			cmdbuf[1] = res;
+			cmdbuf[1] = 0;
 			cmdbuf[2] = (u32)month;
 		}
 		break;
@@ -890,7 +964,7 @@ void MCURTC_HandleIPC()
 			
 			u8 year = (u8)cmdbuf[1] & 0xFF;
 			
-			Result res = mcuSetRtcAlarmField(MCUREG_RTC_ALARM_YEAR, year, LOCK);
+			Result res = mcuSetLegacyRtcAlarmField(MCUREG_RTC_ALARM_YEAR, year);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x001D, 1, 0);
 			cmdbuf[1] = res;
@@ -902,10 +976,10 @@ void MCURTC_HandleIPC()
 			
 			u8 year = 0;
 			
-			Result res = mcuGetRtcAlarmField(MCUREG_RTC_ALARM_YEAR, &year, LOCK);
+			year = mcuGetLegacyRtcAlarmField(MCUREG_RTC_ALARM_YEAR);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x001E, 2, 0);
-			cmdbuf[1] = res;
+			cmdbuf[1] = 0;
 			cmdbuf[2] = (u32)year;
 		}
 		break;
@@ -964,7 +1038,7 @@ void MCURTC_HandleIPC()
 			if (bufsize != sizeof(MCU_PedometerStepData)) {
 				res = MCU_INVALID_SIZE;
 			} else {
-				res = mcuReadPedoemterStepData(buf, LOCK);
+				res = mcuReadPedometerStepDataCached(buf, LOCK);
 			}
 			
 			cmdbuf[0] = IPC_MakeHeader(0x0022, 1, 2);
@@ -979,6 +1053,8 @@ void MCURTC_HandleIPC()
 			
 			Result res = mcuClearPedometerStepData(LOCK);
 			
+			mcuInvalidatePedometerCache();
+			
 			cmdbuf[0] = IPC_MakeHeader(0x0023, 1, 0);
 			cmdbuf[1] = res;
 		}
@@ -1094,13 +1170,13 @@ void MCURTC_HandleIPC()
 		{
 			CHECK_HEADER(0x002D, 0, 0)
 			
-			u8 perc = 0;
+			MCU_BatterySample sample;
 			
-			Result res = mcuReadBatteryPercentageInt(&perc, LOCK);
+			mcuGetBatterySample(&sample);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x002D, 2, 0);
-			cmdbuf[1] = res;
-			cmdbuf[2] = (u32)perc;
+			cmdbuf[1] = 0;
+			cmdbuf[2] = (u32)(sample.percentage >> 8);
 		}
 		break;
 	case 0x002E: // set power LED state
@@ -1109,7 +1185,9 @@ void MCURTC_HandleIPC()
 			
 			u8 state = (u8)cmdbuf[1] & 0xFF;
 			
-			Result res = mcuSetLedState(MCUREG_POWER_LED_STATE, state, LOCK);
+			mcuStopPowerLedSequence();
+			
+			Result res = mcuSetLedStateCoalesced(MCUREG_POWER_LED_STATE, state);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x002E, 1, 0);
 			cmdbuf[1] = res;
@@ -1121,7 +1199,7 @@ void MCURTC_HandleIPC()
 			
 			u8 state = 0;
 			
-			Result res = mcuGetLedState(MCUREG_POWER_LED_STATE, &state, LOCK);
+			Result res = mcuGetLedStateCoalesced(MCUREG_POWER_LED_STATE, &state);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x002F, 2, 0);
 			cmdbuf[1] = res;
@@ -1134,7 +1212,7 @@ void MCURTC_HandleIPC()
 			
 			u8 brightness = (u8)cmdbuf[1] & 0xFF;
 			
-			Result res = mcuSetLedState(MCUREG_LED_BRIGHTNESS_STATE, brightness, LOCK);
+			Result res = mcuSetLedStateCoalesced(MCUREG_LED_BRIGHTNESS_STATE, brightness);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x0030, 1, 0);
 			cmdbuf[1] = res;
@@ -1146,7 +1224,7 @@ void MCURTC_HandleIPC()
 			
 			u8 brightness = 0;
 			
-			Result res = mcuGetLedState(MCUREG_LED_BRIGHTNESS_STATE, &brightness, LOCK);
+			Result res = mcuGetLedStateCoalesced(MCUREG_LED_BRIGHTNESS_STATE, &brightness);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x0031, 2, 0);
 			cmdbuf[1] = res;
@@ -1157,6 +1235,9 @@ void MCURTC_HandleIPC()
 		{
 			CHECK_HEADER(0x0032, 0, 0)
 			
+			/* the final LED states have to reach the MCU before it goes down */
+			mcuFlushCoalescedWrites();
+			
 			Result res = mcuSetPowerState(MCU_PWR_SHUTDOWN, LOCK);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x0032, 1, 0);
@@ -1167,6 +1248,9 @@ void MCURTC_HandleIPC()
 		{
 			CHECK_HEADER(0x0033, 0, 0)
 			
+			/* the final LED states have to reach the MCU before it goes down */
+			mcuFlushCoalescedWrites();
+			
 			Result res = mcuSetPowerState(MCU_PWR_REBOOT, LOCK);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x0033, 1, 0);
@@ -1187,6 +1271,9 @@ void MCURTC_HandleIPC()
 		{
 			CHECK_HEADER(0x0035, 0, 0)
 			
+			/* the final LED states have to reach the MCU before it goes down */
+			mcuFlushCoalescedWrites();
+			
 			Result res = mcuSetPowerState(MCU_PWR_SLEEP, LOCK);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x0035, 1, 0);
@@ -1301,7 +1388,7 @@ void MCURTC_HandleIPC()
 			
 			_memcpy32_aligned(&data, &cmdbuf[1], sizeof(MCU_NotificationLedData));
 			
-			Result res = mcuSetNotificationLedData(&data, LOCK);
+			Result res = mcuSetNotificationLedLayer(NOTIFICATION_LED_LEGACY_OWNER, NOTIFICATION_LED_LEGACY_PRIORITY, 0, &data);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x003B, 1, 0);
 			cmdbuf[1] = res;
@@ -1314,7 +1401,7 @@ void MCURTC_HandleIPC()
 			MCU_NotifictationLedAnimation animation = { 0 };
 			_memcpy32_aligned(&animation, &cmdbuf[1], sizeof(MCU_NotifictationLedAnimation));
 			
-			Result res = mcuSetNotificationLedAnimation(&animation, LOCK);
+			Result res = mcuSetNotificationLedLayerAnimation(NOTIFICATION_LED_LEGACY_OWNER, &animation);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x003C, 1, 0);
 			cmdbuf[1] = res;
@@ -1389,7 +1476,17 @@ void MCURTC_HandleIPC()
 			
 			u32 pattern = cmdbuf[1];
 			
-			Result res = mcuSetPowerLedBlinkPattern(pattern, LOCK);
+			mcuStopPowerLedSequence();
+			
+			Result res;
+			
+			/* the blink pattern write carries the cached mode, so a newer one still held back has to go out first */
+			I2C_LOCKED({
+				res = mcuFlushCoalescedWrite(MCUREG_POWER_LED_STATE);
+				
+				if (R_SUCCEEDED(res))
+					res = mcuSetPowerLedBlinkPattern(pattern, NOLOCK);
+			});
 			
 			cmdbuf[0] = IPC_MakeHeader(0x0042, 1, 0);
 			cmdbuf[1] = res;
@@ -1502,7 +1599,8 @@ void MCURTC_HandleIPC()
 		{
 			CHECK_HEADER(0x004B, 0, 0)
 			
-			RecursiveLock_Unlock(&g_ExclusiveIRQLock);
+			/* legacy clients have no token, release whatever lease this session holds */
+			mcuReleaseExclusiveIrqMode(getThreadLocalStorage());
 			
 			cmdbuf[0] = IPC_MakeHeader(0x004B, 1, 0);
 			cmdbuf[1] = 0;
@@ -1512,10 +1610,12 @@ void MCURTC_HandleIPC()
 		{
 			CHECK_HEADER(0x004C, 0, 0)
 			
-			RecursiveLock_Lock(&g_ExclusiveIRQLock);
+			u32 token = 0;
+			
+			Result res = mcuEnterExclusiveIrqMode(getThreadLocalStorage(), EXCLUSIVE_IRQ_DEFAULT_LEASE_MS, &token);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x004C, 1, 0);
-			cmdbuf[1] = 0;
+			cmdbuf[1] = res;
 		}
 		break;
 	case 0x004D: // get received interrupts
@@ -1523,8 +1623,13 @@ void MCURTC_HandleIPC()
 			CHECK_HEADER(0x004D, 0, 0)
 			
 			u32 received_irqs = 0;
+			Result res = 0;
 			
-			Result res = mcuGetReceivedIrqs(&received_irqs, LOCK);
+			/* in exclusive mode the IRQ thread may already have pulled some of these off the MCU */
+			RecursiveLock_Lock(&g_ExclusiveIRQLock);
+			res = mcuGetReceivedIrqs(&received_irqs, LOCK);
+			received_irqs |= mcuTakeExclusiveIrqs(getThreadLocalStorage());
+			RecursiveLock_Unlock(&g_ExclusiveIRQLock);
 
 			cmdbuf[0] = IPC_MakeHeader(0x004D, 2, 0);
 			cmdbuf[1] = res;
@@ -1714,6 +1819,355 @@ void MCURTC_HandleIPC()
 			cmdbuf[2] = (u32)clockseq;
 		}
 		break;
+	case 0x005D: // enter exclusive interrupt mode with a lease timeout (in milliseconds)
+		{
+			CHECK_HEADER(0x005D, 1, 0)
+			
+			u32 timeout_ms = cmdbuf[1];
+			u32 token = 0;
+			
+			Result res = mcuEnterExclusiveIrqMode(getThreadLocalStorage(), timeout_ms, &token);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x005D, 2, 0);
+			cmdbuf[1] = res;
+			cmdbuf[2] = token;
+		}
+		break;
+	case 0x005E: // leave exclusive interrupt mode by token
+		{
+			CHECK_HEADER(0x005E, 1, 0)
+			
+			u32 token = cmdbuf[1];
+			
+			Result res = mcuLeaveExclusiveIrqMode(token);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x005E, 1, 0);
+			cmdbuf[1] = res;
+		}
+		break;
+	case 0x005F: // get battery event handle (signalled when the integer percentage or temperature band changes)
+		{
+			CHECK_HEADER(0x005F, 0, 0)
+			
+			cmdbuf[0] = IPC_MakeHeader(0x005F, 1, 2);
+			cmdbuf[1] = 0;
+			cmdbuf[2] = IPC_Desc_SharedHandles(1);
+			cmdbuf[3] = g_BatteryEvent;
+		}
+		break;
+	case 0x0060: // get latest battery sample
+		{
+			CHECK_HEADER(0x0060, 0, 0)
+			
+			MCU_BatterySample sample;
+			
+			mcuGetBatterySample(&sample);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0060, 1 + sizeof(MCU_BatterySample) / sizeof(u32), 0);
+			cmdbuf[1] = 0;
+			_memcpy32_aligned(&cmdbuf[2], &sample, sizeof(MCU_BatterySample));
+		}
+		break;
+	case 0x0061: // get estimated minutes to empty/full and confidence
+		{
+			CHECK_HEADER(0x0061, 0, 0)
+			
+			MCU_BatteryEstimate estimate;
+			
+			mcuGetBatteryEstimate(&estimate);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0061, 1 + sizeof(MCU_BatteryEstimate) / sizeof(u32), 0);
+			cmdbuf[1] = 0;
+			_memcpy32_aligned(&cmdbuf[2], &estimate, sizeof(MCU_BatteryEstimate));
+		}
+		break;
+	case 0x0062: // get pedometer hours changed since a generation (newest first)
+		{
+			CHECK_HEADER(0x0062, 2, 2)
+			
+			CHECK_WRONGARG(
+				!IPC_VerifyBuffer(cmdbuf[3], IPC_BUFFER_W) ||
+				IPC_GetBufferSize(cmdbuf[3]) != cmdbuf[2]
+			)
+			
+			u32 generation = cmdbuf[1];
+			u32 size = IPC_GetBufferSize(cmdbuf[3]);
+			MCU_PedometerBucket *buf = (MCU_PedometerBucket *)cmdbuf[4];
+			
+			u32 count = 0;
+			u32 new_generation = 0;
+			
+			Result res = mcuGetPedometerChangesSince(generation, buf, size / sizeof(MCU_PedometerBucket), &count, &new_generation, LOCK);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0062, 3, 2);
+			cmdbuf[1] = res;
+			cmdbuf[2] = count;
+			cmdbuf[3] = new_generation;
+			cmdbuf[4] = IPC_Desc_Buffer(size, IPC_BUFFER_W);
+			cmdbuf[5] = (u32)buf;
+		}
+		break;
+	case 0x0063: // get pedometer statistics (daily totals, week total, peak hour, active hours)
+		{
+			CHECK_HEADER(0x0063, 0, 0)
+			
+			MCU_PedometerStats stats = { 0 };
+			
+			Result res = mcuGetPedometerStats(&stats, LOCK);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0063, 1 + sizeof(MCU_PedometerStats) / sizeof(u32), 0);
+			cmdbuf[1] = res;
+			_memcpy32_aligned(&cmdbuf[2], &stats, sizeof(MCU_PedometerStats));
+		}
+		break;
+	case 0x0064: // subscribe to a step count delta (type 0) or absolute goal (type 1)
+		{
+			CHECK_HEADER(0x0064, 2, 0)
+			
+			u8 type = (u8)cmdbuf[1] & 0xFF;
+			u32 value = cmdbuf[2];
+			
+			u32 id = 0;
+			Handle event = 0;
+			
+			Result res = mcuSubscribeSteps(getThreadLocalStorage(), type, value, &id, &event);
+			
+			if (R_FAILED(res)) {
+				cmdbuf[0] = IPC_MakeHeader(0x0064, 1, 0);
+				cmdbuf[1] = res;
+				break;
+			}
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0064, 2, 2);
+			cmdbuf[1] = res;
+			cmdbuf[2] = id;
+			cmdbuf[3] = IPC_Desc_SharedHandles(1);
+			cmdbuf[4] = event;
+		}
+		break;
+	case 0x0065: // unsubscribe from step count notifications
+		{
+			CHECK_HEADER(0x0065, 1, 0)
+			
+			u32 id = cmdbuf[1];
+			
+			Result res = mcuUnsubscribeSteps(getThreadLocalStorage(), id);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0065, 1, 0);
+			cmdbuf[1] = res;
+		}
+		break;
+	case 0x0066: // schedule an RTC alarm, returns its id and this client's alarm event
+		{
+			CHECK_HEADER(0x0066, 2, 0)
+			
+			MCU_RtcAlarm data = { 0 };
+			
+			_memcpy(&data, &cmdbuf[1], sizeof(MCU_RtcAlarm));
+			
+			u32 id = 0;
+			Handle event = 0;
+			
+			Result res = mcuAddRtcAlarm(getThreadLocalStorage(), &data, &id, &event);
+			
+			if (R_FAILED(res)) {
+				cmdbuf[0] = IPC_MakeHeader(0x0066, 1, 0);
+				cmdbuf[1] = res;
+				break;
+			}
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0066, 2, 2);
+			cmdbuf[1] = res;
+			cmdbuf[2] = id;
+			cmdbuf[3] = IPC_Desc_SharedHandles(1);
+			cmdbuf[4] = event;
+		}
+		break;
+	case 0x0067: // cancel a scheduled RTC alarm by id
+		{
+			CHECK_HEADER(0x0067, 1, 0)
+			
+			u32 id = cmdbuf[1];
+			
+			Result res = mcuCancelRtcAlarm(getThreadLocalStorage(), id);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0067, 1, 0);
+			cmdbuf[1] = res;
+		}
+		break;
+	case 0x0068: // start a wake timer (in milliseconds), returns its id and this client's timer event
+		{
+			CHECK_HEADER(0x0068, 1, 0)
+			
+			u32 ms = cmdbuf[1];
+			
+			u32 id = 0;
+			Handle event = 0;
+			
+			Result res = mcuStartTimer(getThreadLocalStorage(), ms, &id, &event);
+			
+			if (R_FAILED(res)) {
+				cmdbuf[0] = IPC_MakeHeader(0x0068, 1, 0);
+				cmdbuf[1] = res;
+				break;
+			}
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0068, 2, 2);
+			cmdbuf[1] = res;
+			cmdbuf[2] = id;
+			cmdbuf[3] = IPC_Desc_SharedHandles(1);
+			cmdbuf[4] = event;
+		}
+		break;
+	case 0x0069: // cancel a wake timer by id
+		{
+			CHECK_HEADER(0x0069, 1, 0)
+			
+			u32 id = cmdbuf[1];
+			
+			Result res = mcuCancelTimer(getThreadLocalStorage(), id);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0069, 1, 0);
+			cmdbuf[1] = res;
+		}
+		break;
+	case 0x006A: // get wake timer lateness statistics
+		{
+			CHECK_HEADER(0x006A, 0, 0)
+			
+			MCU_TimerStats stats;
+			
+			mcuGetTimerStats(&stats);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x006A, 1 + sizeof(MCU_TimerStats) / sizeof(u32), 0);
+			cmdbuf[1] = 0;
+			_memcpy32_aligned(&cmdbuf[2], &stats, sizeof(MCU_TimerStats));
+		}
+		break;
+	case 0x006B: // get RTC drift estimate and recommended correction
+		{
+			CHECK_HEADER(0x006B, 0, 0)
+			
+			MCU_RtcDriftEstimate estimate;
+			
+			mcuGetRtcDriftEstimate(&estimate);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x006B, 1 + sizeof(MCU_RtcDriftEstimate) / sizeof(u32), 0);
+			cmdbuf[1] = 0;
+			_memcpy32_aligned(&cmdbuf[2], &estimate, sizeof(MCU_RtcDriftEstimate));
+		}
+		break;
+	case 0x006C: // set RTC drift correction auto apply (true/false)
+		{
+			CHECK_HEADER(0x006C, 1, 0)
+			
+			bool enabled = (cmdbuf[1] & 0xFF) != 0;
+			
+			mcuSetRtcDriftAutoApply(enabled);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x006C, 1, 0);
+			cmdbuf[1] = 0;
+		}
+		break;
+	case 0x006D: // get clock snapshot (RTC time, correction, alarm, tick counter and system tick)
+		{
+			CHECK_HEADER(0x006D, 0, 0)
+			
+			MCU_ClockSnapshot snapshot = { 0 };
+			
+			Result res = mcuReadClockSnapshot(&snapshot, LOCK);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x006D, 1 + sizeof(MCU_ClockSnapshot) / sizeof(u32), 0);
+			cmdbuf[1] = res;
+			_memcpy32_aligned(&cmdbuf[2], &snapshot, sizeof(MCU_ClockSnapshot));
+		}
+		break;
+	case 0x006E: // set this client's notification LED layer (priority, duration in milliseconds or 0 until cleared, LED config)
+		{
+			CHECK_HEADER(0x006E, 27, 0)
+			
+			u8 priority = (u8)cmdbuf[1];
+			u32 duration_ms = cmdbuf[2];
+			MCU_NotificationLedData data = { 0 };
+			
+			_memcpy32_aligned(&data, &cmdbuf[3], sizeof(MCU_NotificationLedData));
+			
+			Result res = mcuSetNotificationLedLayer(getThreadLocalStorage(), priority, duration_ms, &data);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x006E, 1, 0);
+			cmdbuf[1] = res;
+		}
+		break;
+	case 0x006F: // clear this client's notification LED layer
+		{
+			CHECK_HEADER(0x006F, 0, 0)
+			
+			Result res = mcuClearNotificationLedLayer(getThreadLocalStorage());
+			
+			cmdbuf[0] = IPC_MakeHeader(0x006F, 1, 0);
+			cmdbuf[1] = res;
+		}
+		break;
+	case 0x0070: // set this client's notification LED layer from a pattern descriptor (priority, duration in milliseconds or 0 until cleared, descriptor)
+		{
+			CHECK_HEADER(0x0070, 5, 0)
+			
+			u8 priority = (u8)cmdbuf[1];
+			u32 duration_ms = cmdbuf[2];
+			MCU_NotificationLedPattern pattern;
+			
+			_memcpy32_aligned(&pattern, &cmdbuf[3], sizeof(MCU_NotificationLedPattern));
+			
+			Result res = mcuSetNotificationLedLayerPattern(getThreadLocalStorage(), priority, duration_ms, &pattern);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0070, 1, 0);
+			cmdbuf[1] = res;
+		}
+		break;
+	case 0x0071: // start a power LED sequence (step count, loop flag, up to 8 steps of mode, blink pattern and duration in milliseconds)
+		{
+			CHECK_HEADER(0x0071, 25, 0)
+			
+			MCU_PowerLedSequence sequence;
+			
+			_memcpy32_aligned(&sequence, &cmdbuf[1], sizeof(MCU_PowerLedSequence));
+			
+			Result res = mcuStartPowerLedSequence(getThreadLocalStorage(), &sequence);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0071, 1, 0);
+			cmdbuf[1] = res;
+		}
+		break;
+	case 0x0072: // stop the power LED sequence (the LED keeps the current step)
+		{
+			CHECK_HEADER(0x0072, 0, 0)
+			
+			mcuStopPowerLedSequence();
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0072, 1, 0);
+			cmdbuf[1] = 0;
+		}
+		break;
+	case 0x0073: // flush coalesced LED writes to the MCU now
+		{
+			CHECK_HEADER(0x0073, 0, 0)
+			
+			Result res = mcuFlushCoalescedWrites();
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0073, 1, 0);
+			cmdbuf[1] = res;
+		}
+		break;
+	case 0x0074: // get status page memory block handle (read-only, MCU_StatusPage)
+		{
+			CHECK_HEADER(0x0074, 0, 0)
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0074, 1, 2);
+			cmdbuf[1] = 0;
+			cmdbuf[2] = IPC_Desc_SharedHandles(1);
+			cmdbuf[3] = mcuGetStatusPageBlock();
+		}
+		break;
 	default:
 		RET_OS_INVALID_IPCARG;
 	}
@@ -1765,6 +2219,41 @@ void MCUSND_HandleIPC()
 			cmdbuf[2] = (u32)value;
 		}
 		break;
+	case 0x0004: // get volume slider event handle (signalled when the slider moves)
+		{
+			CHECK_HEADER(0x0004, 0, 0)
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0004, 1, 2);
+			cmdbuf[1] = 0;
+			cmdbuf[2] = IPC_Desc_SharedHandles(1);
+			cmdbuf[3] = g_VolumeSliderEvent;
+		}
+		break;
+	case 0x0005: // get calibrated volume level (0-63) and raw slider position
+		{
+			CHECK_HEADER(0x0005, 0, 0)
+			
+			u8 level = 0;
+			u8 raw = 0;
+			
+			Result res = mcuGetVolumeLevel(&level, &raw, LOCK);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0005, 3, 0);
+			cmdbuf[1] = res;
+			cmdbuf[2] = (u32)level;
+			cmdbuf[3] = (u32)raw;
+		}
+		break;
+	case 0x0006: // get status page memory block handle (read-only, MCU_StatusPage)
+		{
+			CHECK_HEADER(0x0006, 0, 0)
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0006, 1, 2);
+			cmdbuf[1] = 0;
+			cmdbuf[2] = IPC_Desc_SharedHandles(1);
+			cmdbuf[3] = mcuGetStatusPageBlock();
+		}
+		break;
 	default:
 		RET_OS_INVALID_IPCARG;
 	}
@@ -1784,7 +2273,7 @@ void MCUNWM_HandleIPC()
 			
 			u8 state = (u8)cmdbuf[1] & 0xFF;
 			
-			Result res = mcuSetLedState(MCUREG_WLAN_LED_STATE, state, LOCK);
+			Result res = mcuSetLedStateCoalesced(MCUREG_WLAN_LED_STATE, state);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x0001, 1, 0);
 			cmdbuf[1] = res;
@@ -1796,7 +2285,7 @@ void MCUNWM_HandleIPC()
 			
 			u8 state = 0;
 			
-			Result res = mcuGetLedState(MCUREG_WLAN_LED_STATE, &state, LOCK);
+			Result res = mcuGetLedStateCoalesced(MCUREG_WLAN_LED_STATE, &state);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x0002, 2, 0);
 			cmdbuf[1] = res;
@@ -1809,7 +2298,7 @@ void MCUNWM_HandleIPC()
 			
 			u8 mode = (u8)cmdbuf[1] & 0xFF; /* 0 = CTR, 1 = MP (DS[i] WiFi) */
 			
-			Result res = gpioMcuWriteData_l((mode == GPIO_WLAN_MODE_MP) * GPIO_WLAN_MODE, GPIO_WLAN_MODE);
+			Result res = gpioMcuWriteWlanData_l((mode == GPIO_WLAN_MODE_MP) * GPIO_WLAN_MODE, GPIO_WLAN_MODE);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x0003, 1, 0);
 			cmdbuf[1] = res;
@@ -1821,7 +2310,7 @@ void MCUNWM_HandleIPC()
 			
 			u32 mode = 0;
 			
-			Result res = gpioMcuReadData_l(&mode, GPIO_WLAN_MODE);
+			Result res = gpioMcuReadWlanData_l(&mode, GPIO_WLAN_MODE);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x0004, 2, 0);
 			cmdbuf[1] = res;
@@ -1839,7 +2328,7 @@ void MCUNWM_HandleIPC()
 			GPIO_LOCKED({
 				//res = gpioMcuSetRegPart1(GPIO_WLAN_STATE, GPIO_WLAN_STATE);
 				//if (R_SUCCEEDED(res)) {
-					res = gpioMcuWriteData(value ? GPIO_WLAN_STATE : 0, GPIO_WLAN_STATE);
+					res = gpioMcuWriteWlanData(value ? GPIO_WLAN_STATE : 0, GPIO_WLAN_STATE);
 					//}
 			});
 			
@@ -1858,7 +2347,7 @@ void MCUNWM_HandleIPC()
 			GPIO_LOCKED({
 				//res = gpioMcuSetRegPart1(GPIO_WLAN_STATE, GPIO_WLAN_STATE);
 				//if (R_SUCCEEDED(res)) {
-					res = gpioMcuReadData(&status, GPIO_WLAN_STATE);
+					res = gpioMcuReadWlanData(&status, GPIO_WLAN_STATE);
 					//}
 			});
 			
@@ -1892,6 +2381,16 @@ void MCUNWM_HandleIPC()
 			cmdbuf[2] = (u32)set;
 		}
 		break;
+	case 0x0009: // get status page memory block handle (read-only, MCU_StatusPage)
+		{
+			CHECK_HEADER(0x0009, 0, 0)
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0009, 1, 2);
+			cmdbuf[1] = 0;
+			cmdbuf[2] = IPC_Desc_SharedHandles(1);
+			cmdbuf[3] = mcuGetStatusPageBlock();
+		}
+		break;
 	default:
 		RET_OS_INVALID_IPCARG;
 	}
@@ -1971,26 +2470,26 @@ void MCUHWC_HandleIPC()
 		{
 			CHECK_HEADER(0x0004, 0, 0)
 			
-			u8 value = 0;
+			MCU_BatterySample sample;
 			
-			Result res = mcuReadBatteryVoltage(&value, LOCK);
+			mcuGetBatterySample(&sample);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x0004, 2, 0);
-			cmdbuf[1] = res;
-			cmdbuf[2] = (u32)value;
+			cmdbuf[1] = 0;
+			cmdbuf[2] = (u32)(sample.voltage);
 		}
 		break;
 	case 0x0005: // read battery percentage (integer part)
 		{
 			CHECK_HEADER(0x0005, 0, 0)
 			
-			u8 value = 0;
+			MCU_BatterySample sample;
 			
-			Result res = mcuReadBatteryPercentageInt(&value, LOCK);
+			mcuGetBatterySample(&sample);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x0005, 2, 0);
-			cmdbuf[1] = res;
-			cmdbuf[2] = (u32)value;
+			cmdbuf[1] = 0;
+			cmdbuf[2] = (u32)(sample.percentage >> 8);
 		}
 		break;
 	case 0x0006: // set power LED state
@@ -1999,7 +2498,9 @@ void MCUHWC_HandleIPC()
 			
 			u8 state = (u8)cmdbuf[1] & 0xFF;
 			
-			Result res = mcuSetLedState(MCUREG_POWER_LED_STATE, state, LOCK);
+			mcuStopPowerLedSequence();
+			
+			Result res = mcuSetLedStateCoalesced(MCUREG_POWER_LED_STATE, state);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x0006, 1, 0);
 			cmdbuf[1] = res;
@@ -2011,7 +2512,7 @@ void MCUHWC_HandleIPC()
 			
 			u8 state = (u8)cmdbuf[1] & 0xFF;
 			
-			Result res = mcuSetLedState(MCUREG_WLAN_LED_STATE, state, LOCK);
+			Result res = mcuSetLedStateCoalesced(MCUREG_WLAN_LED_STATE, state);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x0007, 1, 0);
 			cmdbuf[1] = res;
@@ -2023,7 +2524,7 @@ void MCUHWC_HandleIPC()
 			
 			u8 state = (u8)cmdbuf[1] & 0xFF;
 			
-			Result res = mcuSetLedState(MCUREG_CAMERA_LED_STATE, state, LOCK);
+			Result res = mcuSetLedStateCoalesced(MCUREG_CAMERA_LED_STATE, state);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x0008, 1, 0);
 			cmdbuf[1] = res;
@@ -2035,7 +2536,7 @@ void MCUHWC_HandleIPC()
 			
 			u8 state = (u8)cmdbuf[1] & 0xFF;
 			
-			Result res = mcuSetLedState(MCUREG_3D_LED_STATE, state, LOCK);
+			Result res = mcuSetLedStateCoalesced(MCUREG_3D_LED_STATE, state);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x0009, 1, 0);
 			cmdbuf[1] = res;
@@ -2049,7 +2550,7 @@ void MCUHWC_HandleIPC()
 			
 			_memcpy32_aligned(&data, &cmdbuf[1], sizeof(MCU_NotificationLedData));
 			
-			Result res = mcuSetNotificationLedData(&data, LOCK);
+			Result res = mcuSetNotificationLedLayer(NOTIFICATION_LED_LEGACY_OWNER, NOTIFICATION_LED_LEGACY_PRIORITY, 0, &data);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x000A, 1, 0);
 			cmdbuf[1] = res;
@@ -2096,13 +2597,13 @@ void MCUHWC_HandleIPC()
 		{
 			CHECK_HEADER(0x000E, 0, 0)
 			
-			u8 value = 0;
+			MCU_BatterySample sample;
 			
-			Result res = mcuReadBatteryPcbTemperature(&value, LOCK);
+			mcuGetBatterySample(&sample);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x000E, 2, 0);
-			cmdbuf[1] = res;
-			cmdbuf[2] = (u32)value;
+			cmdbuf[1] = 0;
+			cmdbuf[2] = (u32)(sample.temperature);
 		}
 		break;
 	case 0x000F: // read RTC time (full)
@@ -2144,6 +2645,198 @@ void MCUHWC_HandleIPC()
 			cmdbuf[2] = (u32)value;
 		}
 		break;
+	case 0x0012: // get IRQ watchdog poll statistics
+		{
+			CHECK_HEADER(0x0012, 0, 0)
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0012, 1 + sizeof(MCU_IrqPollStats) / sizeof(u32), 0);
+			cmdbuf[1] = 0;
+			
+			RecursiveLock_Lock(&g_ExclusiveIRQLock);
+			_memcpy32_aligned(&cmdbuf[2], &g_IrqPollStats, sizeof(MCU_IrqPollStats));
+			RecursiveLock_Unlock(&g_ExclusiveIRQLock);
+		}
+		break;
+	case 0x0013: // set IRQ watchdog poll interval bounds (in milliseconds, the maximum is capped at 60000)
+		{
+			CHECK_HEADER(0x0013, 2, 0)
+			
+			u32 min_ms = cmdbuf[1];
+			u32 max_ms = MIN(cmdbuf[2], IRQ_POLL_MAX_INTERVAL_MS);
+			
+			Result res = 0;
+			
+			if (min_ms == 0 || min_ms > max_ms) {
+				res = MCU_OUT_OF_RANGE;
+			} else {
+				/* the IRQ thread updates these under the same lock */
+				RecursiveLock_Lock(&g_ExclusiveIRQLock);
+				g_IrqPollStats.min_interval_ms = min_ms;
+				g_IrqPollStats.max_interval_ms = max_ms;
+				g_IrqPollStats.interval_ms = min_ms;
+				RecursiveLock_Unlock(&g_ExclusiveIRQLock);
+			}
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0013, 1, 0);
+			cmdbuf[1] = res;
+		}
+		break;
+	case 0x0014: // dump IRQ trace records (oldest first)
+		{
+			CHECK_HEADER(0x0014, 1, 2)
+			
+			CHECK_WRONGARG(
+				!IPC_VerifyBuffer(cmdbuf[2], IPC_BUFFER_W) ||
+				IPC_GetBufferSize(cmdbuf[2]) != cmdbuf[1]
+			)
+			
+			u32 size = IPC_GetBufferSize(cmdbuf[2]);
+			MCU_IrqTraceRecord *buf = (MCU_IrqTraceRecord *)cmdbuf[3];
+			
+			u32 total = 0;
+			u32 count = mcuDumpIrqTrace(buf, size / sizeof(MCU_IrqTraceRecord), &total);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0014, 3, 2);
+			cmdbuf[1] = 0;
+			cmdbuf[2] = count;
+			cmdbuf[3] = total;
+			cmdbuf[4] = IPC_Desc_Buffer(size, IPC_BUFFER_W);
+			cmdbuf[5] = (u32)buf;
+		}
+		break;
+	case 0x0015: // get IRQ latency percentiles
+		{
+			CHECK_HEADER(0x0015, 0, 0)
+			
+			MCU_IrqTraceSummary summary;
+			
+			mcuGetIrqTraceSummary(&summary);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0015, 1 + sizeof(MCU_IrqTraceSummary) / sizeof(u32), 0);
+			cmdbuf[1] = 0;
+			_memcpy32_aligned(&cmdbuf[2], &summary, sizeof(MCU_IrqTraceSummary));
+		}
+		break;
+	case 0x0016: // dump battery sample history (oldest first)
+		{
+			CHECK_HEADER(0x0016, 1, 2)
+			
+			CHECK_WRONGARG(
+				!IPC_VerifyBuffer(cmdbuf[2], IPC_BUFFER_W) ||
+				IPC_GetBufferSize(cmdbuf[2]) != cmdbuf[1]
+			)
+			
+			u32 size = IPC_GetBufferSize(cmdbuf[2]);
+			MCU_BatterySample *buf = (MCU_BatterySample *)cmdbuf[3];
+			
+			u32 total = 0;
+			u32 count = mcuGetBatteryHistory(buf, size / sizeof(MCU_BatterySample), &total);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0016, 3, 2);
+			cmdbuf[1] = 0;
+			cmdbuf[2] = count;
+			cmdbuf[3] = total;
+			cmdbuf[4] = IPC_Desc_Buffer(size, IPC_BUFFER_W);
+			cmdbuf[5] = (u32)buf;
+		}
+		break;
+	case 0x0017: // get notification LED upload statistics
+		{
+			CHECK_HEADER(0x0017, 0, 0)
+			
+			MCU_NotificationLedStats stats;
+			
+			mcuGetNotificationLedStats(&stats);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0017, 1 + sizeof(MCU_NotificationLedStats) / sizeof(u32), 0);
+			cmdbuf[1] = 0;
+			_memcpy32_aligned(&cmdbuf[2], &stats, sizeof(MCU_NotificationLedStats));
+		}
+		break;
+	case 0x0018: // set the write coalescing window of an LED state register (in milliseconds, 0 writes straight through)
+		{
+			CHECK_HEADER(0x0018, 2, 0)
+			
+			u8 regid = (u8)cmdbuf[1] & 0xFF;
+			u32 window_ms = cmdbuf[2];
+			
+			Result res = mcuSetCoalesceWindow(regid, window_ms);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0018, 1, 0);
+			cmdbuf[1] = res;
+		}
+		break;
+	case 0x0019: // get status page memory block handle (read-only, MCU_StatusPage)
+		{
+			CHECK_HEADER(0x0019, 0, 0)
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0019, 1, 2);
+			cmdbuf[1] = 0;
+			cmdbuf[2] = IPC_Desc_SharedHandles(1);
+			cmdbuf[3] = mcuGetStatusPageBlock();
+		}
+		break;
+	case 0x001A: // watch a register (register, mask, poll interval in milliseconds), returns its id, current masked value and an event signalled on change
+		{
+			CHECK_HEADER(0x001A, 3, 0)
+			
+			u8 regid = (u8)cmdbuf[1] & 0xFF;
+			u8 mask = (u8)cmdbuf[2] & 0xFF;
+			u32 interval_ms = cmdbuf[3];
+			
+			u32 id = 0;
+			u8 value = 0;
+			Handle event = 0;
+			
+			Result res = mcuAddRegisterWatch(getThreadLocalStorage(), regid, mask, interval_ms, &id, &value, &event);
+			
+			if (R_FAILED(res)) {
+				cmdbuf[0] = IPC_MakeHeader(0x001A, 1, 0);
+				cmdbuf[1] = res;
+				break;
+			}
+			
+			cmdbuf[0] = IPC_MakeHeader(0x001A, 3, 2);
+			cmdbuf[1] = res;
+			cmdbuf[2] = id;
+			cmdbuf[3] = (u32)value;
+			cmdbuf[4] = IPC_Desc_SharedHandles(1);
+			cmdbuf[5] = event;
+		}
+		break;
+	case 0x001B: // remove a register watch by id
+		{
+			CHECK_HEADER(0x001B, 1, 0)
+			
+			u32 id = cmdbuf[1];
+			
+			Result res = mcuRemoveRegisterWatch(getThreadLocalStorage(), id);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x001B, 1, 0);
+			cmdbuf[1] = res;
+		}
+		break;
+	case 0x001C: // get the boot profile (MCU_BootProfile)
+		{
+			CHECK_HEADER(0x001C, 0, 0)
+			
+			cmdbuf[0] = IPC_MakeHeader(0x001C, 1 + sizeof(MCU_BootProfile) / sizeof(u32), 0);
+			cmdbuf[1] = 0;
+			_memcpy32_aligned(&cmdbuf[2], &g_BootProfile, sizeof(MCU_BootProfile));
+		}
+		break;
+	case 0x001D: // enable or disable serving static register reads from the snapshot (enabling takes a fresh one)
+		{
+			CHECK_HEADER(0x001D, 1, 0)
+			
+			bool warm = (cmdbuf[1] & 0xFF) != 0;
+			
+			Result res = mcuSetRegisterSnapshotWarm(warm);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x001D, 1, 0);
+			cmdbuf[1] = res;
+		}
+		break;
 	default:
 			RET_OS_INVALID_IPCARG;
 	}
@@ -2161,13 +2854,13 @@ void MCUPLS_HandleIPC()
 		{
 			CHECK_HEADER(0x0001, 0, 0)
 			
-			MCU_RtcData data = { 0 };
+			MCU_ClockSnapshot snapshot = { 0 };
 			
-			Result res = mcuGetRtcTime(&data, LOCK);
+			Result res = mcuReadClockSnapshot(&snapshot, LOCK);
 			
 			cmdbuf[0] = IPC_MakeHeader(0x0001, 3, 0);
 			cmdbuf[1] = res;
-			_memcpy(&cmdbuf[2], &data, sizeof(MCU_RtcData));
+			_memcpy(&cmdbuf[2], &snapshot.time, sizeof(MCU_RtcData));
 		}
 		break;
 	case 0x0002: // get RTC time (second part)
@@ -2274,6 +2967,29 @@ void MCUPLS_HandleIPC()
 			cmdbuf[2] = value;
 		}
 		break;
+	case 0x000A: // get clock snapshot (RTC time, correction, alarm, tick counter and system tick)
+		{
+			CHECK_HEADER(0x000A, 0, 0)
+			
+			MCU_ClockSnapshot snapshot = { 0 };
+			
+			Result res = mcuReadClockSnapshot(&snapshot, LOCK);
+			
+			cmdbuf[0] = IPC_MakeHeader(0x000A, 1 + sizeof(MCU_ClockSnapshot) / sizeof(u32), 0);
+			cmdbuf[1] = res;
+			_memcpy32_aligned(&cmdbuf[2], &snapshot, sizeof(MCU_ClockSnapshot));
+		}
+		break;
+	case 0x000B: // get status page memory block handle (read-only, MCU_StatusPage)
+		{
+			CHECK_HEADER(0x000B, 0, 0)
+			
+			cmdbuf[0] = IPC_MakeHeader(0x000B, 1, 2);
+			cmdbuf[1] = 0;
+			cmdbuf[2] = IPC_Desc_SharedHandles(1);
+			cmdbuf[3] = mcuGetStatusPageBlock();
+		}
+		break;
 	default:
 			RET_OS_INVALID_IPCARG;
 	}
@@ -2297,6 +3013,16 @@ void MCUCDC_HandleIPC()
 			cmdbuf[1] = res;
 		}
 		break;
+	case 0x0002: // get status page memory block handle (read-only, MCU_StatusPage)
+		{
+			CHECK_HEADER(0x0002, 0, 0)
+			
+			cmdbuf[0] = IPC_MakeHeader(0x0002, 1, 2);
+			cmdbuf[1] = 0;
+			cmdbuf[2] = IPC_Desc_SharedHandles(1);
+			cmdbuf[3] = mcuGetStatusPageBlock();
+		}
+		break;
 	default:
 		RET_OS_INVALID_IPCARG;
 	}
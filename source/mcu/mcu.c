@@ -1,10 +1,15 @@
+#include <mcu/snapshot.h>
 #include <mcu/globals.h>
+#include <mcu/battery.h>
+#include <mcu/status.h>
+#include <mcu/alarm.h>
 #include <mcu/mcu.h>
 #include <mcu/acc.h>
 #include <3ds/srv.h>
 #include <3ds/i2c.h>
 #include <3ds/err.h>
 #include <3ds/gpio.h>
+#include <memops.h>
 #include <util.h>
 
 RecursiveLock g_I2CLock;
@@ -18,12 +23,29 @@ Handle g_GPIO_MCUInterruptEvent;
 Handle g_IRQEvents[3];
 u32 g_ReceivedIRQs[3];
 
+Handle g_VolumeSliderEvent;
+
+RecursiveLock g_BatteryLock;
+Handle g_BatteryEvent;
+
+Handle g_WorkerEvent;
+
+RecursiveLock g_TimerLock;
+RecursiveLock g_RtcDriftLock;
+RecursiveLock g_WatchLock;
+
+RecursiveLock g_LcdSequenceLock;
+RecursiveLock g_StatusPageLock;
+Handle g_LcdAckEvent;
+
 bool g_McuFirmWasUpdated;
 
 // i2c mcu
 inline Result mcuSetRegisterBits8(u8 regid, u8 mask, u8 data)
 {
-	return I2C_SetRegisterBits8(I2C_DEVICE_MCU, regid, mask, data);
+	Result res = I2C_SetRegisterBits8(I2C_DEVICE_MCU, regid, mask, data);
+	mcuTrackRegisterBits(regid, mask, data, R_SUCCEEDED(res));
+	return res;
 }
 
 Result mcuSetRegisterBits8_l(u8 regid, u8 mask, u8 data)
@@ -35,7 +57,9 @@ Result mcuSetRegisterBits8_l(u8 regid, u8 mask, u8 data)
 
 inline Result mcuDisableRegisterBits8(u8 regid, u8 mask)
 {
-	return I2C_DisableRegisterBits8(I2C_DEVICE_MCU, regid, mask);
+	Result res = I2C_DisableRegisterBits8(I2C_DEVICE_MCU, regid, mask);
+	mcuTrackRegisterBits(regid, mask, 0, R_SUCCEEDED(res));
+	return res;
 }
 
 Result mcuDisableRegisterBits8_l(u8 regid, u8 mask)
@@ -47,7 +71,9 @@ Result mcuDisableRegisterBits8_l(u8 regid, u8 mask)
 
 inline Result mcuWriteRegisterBuffer8(u8 regid, const void *buf, u32 size)
 {
-	return I2C_WriteRegisterBuffer8(I2C_DEVICE_MCU, regid, buf, size);
+	Result res = I2C_WriteRegisterBuffer8(I2C_DEVICE_MCU, regid, buf, size);
+	mcuTrackRegisterWrite(regid, buf, size, R_SUCCEEDED(res));
+	return res;
 }
 
 Result mcuWriteRegisterBuffer8_l(u8 regid, const void *buf, u32 size)
@@ -59,6 +85,10 @@ Result mcuWriteRegisterBuffer8_l(u8 regid, const void *buf, u32 size)
 
 inline Result mcuReadRegisterBuffer8(u8 regid, void *buf, u32 size)
 {
+	if (mcuReadRegisterSnapshot(regid, buf, size))
+		return 0;
+	
+	mcuTrackRegisterRead(regid);
 	return I2C_ReadRegisterBuffer8(I2C_DEVICE_MCU, regid, buf, size);
 }
 
@@ -71,7 +101,9 @@ Result mcuReadRegisterBuffer8_l(u8 regid, void *buf, u32 size)
 
 inline Result mcuWriteRegisterBuffer(u8 regid, const void *buf, u32 size)
 {
-	return I2C_WriteRegisterBuffer(I2C_DEVICE_MCU, regid, buf, size);
+	Result res = I2C_WriteRegisterBuffer(I2C_DEVICE_MCU, regid, buf, size);
+	mcuTrackRegisterWrite(regid, buf, size, R_SUCCEEDED(res));
+	return res;
 }
 
 Result mcuWriteRegisterBuffer_l(u8 regid, const void *buf, u32 size)
@@ -83,6 +115,10 @@ Result mcuWriteRegisterBuffer_l(u8 regid, const void *buf, u32 size)
 
 inline Result mcuReadRegisterBuffer(u8 regid, void *buf, u32 size)
 {
+	if (mcuReadRegisterSnapshot(regid, buf, size))
+		return 0;
+	
+	mcuTrackRegisterRead(regid);
 	return I2C_ReadRegisterBuffer(I2C_DEVICE_MCU, regid, buf, size);
 }
 
@@ -167,6 +203,103 @@ Result gpioMcuUnbindInterrupt_l(u32 irq_mask, Handle syncobj)
 	);
 }
 
+#define GPIO_WLAN_SHADOWED (GPIO_WLAN_MODE | GPIO_WLAN_STATE)
+
+/*
+	Shadow of the WLAN GPIO pins. Nothing but this module drives them, so once
+	a pin's level has been read or written, RAM knows it as well as the GPIO
+	does. Under g_GPIOLock.
+*/
+static struct {
+	u32 valid; /* pins with a known level */
+	u32 value;
+} s_WlanGpio;
+
+inline Result gpioMcuReadWlanData(u32 *out_value, u32 mask)
+{
+	u32 missing = mask & GPIO_WLAN_SHADOWED & ~s_WlanGpio.valid;
+	
+	if (missing) {
+		u32 value = 0;
+		
+		Result res = gpioMcuReadData(&value, missing);
+		if (R_FAILED(res)) return res;
+		
+		s_WlanGpio.value = (s_WlanGpio.value & ~missing) | (value & missing);
+		s_WlanGpio.valid |= missing;
+	}
+	
+	*out_value = s_WlanGpio.value & mask;
+	return 0;
+}
+
+Result gpioMcuReadWlanData_l(u32 *out_value, u32 mask)
+{
+	GPIO_LOCKED_R(
+		gpioMcuReadWlanData(out_value, mask)
+	);
+}
+
+inline Result gpioMcuWriteWlanData(u32 value, u32 mask)
+{
+	mask &= GPIO_WLAN_SHADOWED;
+	
+	if ((s_WlanGpio.valid & mask) == mask && (s_WlanGpio.value & mask) == (value & mask))
+		return 0;
+	
+	Result res = gpioMcuWriteData(value, mask);
+	
+	if (R_SUCCEEDED(res)) {
+		s_WlanGpio.value = (s_WlanGpio.value & ~mask) | (value & mask);
+		s_WlanGpio.valid |= mask;
+	} else {
+		s_WlanGpio.valid &= ~mask;
+	}
+	
+	return res;
+}
+
+Result gpioMcuWriteWlanData_l(u32 value, u32 mask)
+{
+	GPIO_LOCKED_R(
+		gpioMcuWriteWlanData(value, mask)
+	);
+}
+
+/* the actual pin levels, read fresh since whatever comes next (a firmware update) may reset them */
+Result gpioMcuSnapshotWlan(u32 *out_snapshot)
+{
+	Result res;
+	
+	GPIO_LOCKED({
+		s_WlanGpio.valid = 0;
+		
+		gpioMcuSetRegPart1(0, GPIO_WLAN_STATE); // not needed? will error
+		res = gpioMcuReadWlanData(out_snapshot, GPIO_WLAN_SHADOWED);
+	});
+	
+	return res;
+}
+
+/* puts the pins back the way the snapshot had them, written even if the shadow thinks they already are */
+Result gpioMcuRestoreWlan(u32 snapshot)
+{
+	Result res;
+	
+	GPIO_LOCKED({
+		s_WlanGpio.valid = 0;
+		
+		res = gpioMcuWriteWlanData(snapshot, GPIO_WLAN_MODE);
+		
+		if (R_SUCCEEDED(res)) {
+			gpioMcuSetRegPart1(GPIO_WLAN_STATE, GPIO_WLAN_STATE); // not needed? will error
+			res = gpioMcuWriteWlanData(snapshot, GPIO_WLAN_STATE);
+		}
+	});
+	
+	return res;
+}
+
 /* Non Fatal assert */
 #define NF(expr) do { \
 	Result __tmp = expr; \
@@ -174,6 +307,9 @@ Result gpioMcuUnbindInterrupt_l(u32 irq_mask, Handle syncobj)
 		Err_Throw(__tmp); \
 	} while (0);
 
+/* MCUINT_VIDEO_* seen and not yet claimed by mcuSequenceLcdPower, under g_I2CLock */
+static u32 s_LcdAcks;
+
 void mcuHandleInterruptEvents(u32 received_irqs)
 {
 	static const u32 filtered_events[3] = {
@@ -192,6 +328,10 @@ void mcuHandleInterruptEvents(u32 received_irqs)
 	if (received_irqs == 0xFFFFFFFF)
 		T(mcuGetReceivedIrqs(&received_irqs, LOCK));
 	
+	/* the hardware alarm is shared by the scheduled alarms, mcu::RTC only hears about its own */
+	if ((received_irqs & MCUINT_RTC_ALARM) && !mcuFireRtcAlarms())
+		received_irqs &= ~MCUINT_RTC_ALARM;
+	
 	for (int i = 0; i < 3; i++) {
 		if (received_irqs & filtered_events[i]) {
 			g_ReceivedIRQs[i] |= (received_irqs & filtered_events[i]);
@@ -210,6 +350,31 @@ void mcuHandleInterruptEvents(u32 received_irqs)
 	if (received_irqs & MCUINT_ACCELEROMETER_I2C_MANUAL_IO)
 		LightEvent_Signal(&g_AccelerometerManualI2CEvent);
 	
+	/* gsp still gets them through its event, the LCD sequencing command keeps its own copy */
+	if (received_irqs & filtered_events[EVENT_GPU]) {
+		I2C_LOCKED(
+			s_LcdAcks |= received_irqs & filtered_events[EVENT_GPU]
+		)
+		T(svcSignalEvent(g_LcdAckEvent));
+	}
+	
+	if (received_irqs & (MCUINT_AC_ADAPTER_REMOVED | MCUINT_AC_ADAPTER_PLUGGED_IN | MCUINT_CHARGING_STOP | MCUINT_CHARGING_START))
+		mcuRequestBatterySample();
+	
+	/* everything that flips an MCU_PWRSTAT_* bit, so the status page doesn't wait for the next battery sample */
+	if (received_irqs & (MCUINT_SHELL_CLOSE | MCUINT_SHELL_OPEN | MCUINT_AC_ADAPTER_REMOVED | MCUINT_AC_ADAPTER_PLUGGED_IN |
+	                     MCUINT_CHARGING_STOP | MCUINT_CHARGING_START | filtered_events[EVENT_GPU])) {
+		u8 power_status = 0;
+		
+		if (R_SUCCEEDED(mcuGetPowerStatus(&power_status, LOCK)))
+			mcuPublishPowerStatus(power_status);
+	}
+	
+	if (received_irqs & MCUINT_VOL_SLIDER) {
+		T(mcuRefreshVolumeSlider(LOCK));
+		T(svcSignalEvent(g_VolumeSliderEvent));
+	}
+	
 	if (received_irqs & (MCUINT_SHELL_CLOSE | MCUINT_SHELL_OPEN))
 		NF(SRV_PublishToSubscriber(MCUNOTIF_SHELL_STATE_CHANGE, SRVNOTIF_ONLY_IF_NOT_PENDING));
 	
@@ -246,6 +411,153 @@ void mcuHandleInterruptEvents(u32 received_irqs)
 		NF(SRV_PublishToSubscriber(MCUNOTIF_STOPPED_CHARGING, 0));
 }
 
+// exclusive interrupt mode
+
+#define EXCLUSIVE_IRQ_QUEUE_SIZE 16
+
+typedef struct MCU_QueuedIrqs {
+	u32 irqs;
+	s64 tick;
+} MCU_QueuedIrqs;
+
+static struct {
+	bool active;
+	void *owner; /* thread local storage of the owning session thread */
+	u32 token;
+	s64 deadline;
+	u32 queued;
+	MCU_QueuedIrqs queue[EXCLUSIVE_IRQ_QUEUE_SIZE];
+} s_ExclusiveIrqLease;
+
+static void _mcuEndExclusiveIrqLease()
+{
+	s_ExclusiveIrqLease.active = false;
+	s_ExclusiveIrqLease.owner = NULL;
+	
+	/* deliver whatever arrived during the lease, in the order it arrived */
+	for (u32 i = 0; i < s_ExclusiveIrqLease.queued; i++)
+		mcuHandleInterruptEvents(s_ExclusiveIrqLease.queue[i].irqs);
+	
+	s_ExclusiveIrqLease.queued = 0;
+}
+
+Result mcuEnterExclusiveIrqMode(void *owner, u32 timeout_ms, u32 *out_token)
+{
+	Result res = 0;
+	
+	RecursiveLock_Lock(&g_ExclusiveIRQLock);
+	
+	if (s_ExclusiveIrqLease.active && s_ExclusiveIrqLease.owner != owner) {
+		res = MCU_EXCLUSIVE_IRQ_BUSY;
+	} else {
+		/* entering again while holding the lease just extends it */
+		if (!s_ExclusiveIrqLease.active) {
+			if (++s_ExclusiveIrqLease.token == 0)
+				s_ExclusiveIrqLease.token = 1;
+			
+			s_ExclusiveIrqLease.active = true;
+			s_ExclusiveIrqLease.owner = owner;
+			s_ExclusiveIrqLease.queued = 0;
+		}
+		
+		s_ExclusiveIrqLease.deadline = svcGetSystemTick() + MS_TO_TICKS(MIN(timeout_ms, EXCLUSIVE_IRQ_MAX_LEASE_MS));
+		*out_token = s_ExclusiveIrqLease.token;
+	}
+	
+	RecursiveLock_Unlock(&g_ExclusiveIRQLock);
+	
+	return res;
+}
+
+Result mcuLeaveExclusiveIrqMode(u32 token)
+{
+	Result res = 0;
+	
+	RecursiveLock_Lock(&g_ExclusiveIRQLock);
+	
+	if (!s_ExclusiveIrqLease.active || s_ExclusiveIrqLease.token != token)
+		res = MCU_INVALID_TOKEN;
+	else
+		_mcuEndExclusiveIrqLease();
+	
+	RecursiveLock_Unlock(&g_ExclusiveIRQLock);
+	
+	return res;
+}
+
+void mcuReleaseExclusiveIrqMode(void *owner)
+{
+	RecursiveLock_Lock(&g_ExclusiveIRQLock);
+	
+	if (s_ExclusiveIrqLease.active && s_ExclusiveIrqLease.owner == owner)
+		_mcuEndExclusiveIrqLease();
+	
+	RecursiveLock_Unlock(&g_ExclusiveIRQLock);
+}
+
+u32 mcuTakeExclusiveIrqs(void *owner)
+{
+	u32 irqs = 0;
+	
+	RecursiveLock_Lock(&g_ExclusiveIRQLock);
+	
+	/* the lease holder reads IRQs itself, so what it takes here is not replayed later */
+	if (s_ExclusiveIrqLease.active && s_ExclusiveIrqLease.owner == owner) {
+		for (u32 i = 0; i < s_ExclusiveIrqLease.queued; i++)
+			irqs |= s_ExclusiveIrqLease.queue[i].irqs;
+		
+		s_ExclusiveIrqLease.queued = 0;
+	}
+	
+	RecursiveLock_Unlock(&g_ExclusiveIRQLock);
+	
+	return irqs;
+}
+
+s64 mcuUpdateExclusiveIrqLease(s64 now)
+{
+	s64 deadline = 0;
+	
+	RecursiveLock_Lock(&g_ExclusiveIRQLock);
+	
+	if (s_ExclusiveIrqLease.active) {
+		if (now >= s_ExclusiveIrqLease.deadline)
+			_mcuEndExclusiveIrqLease();
+		else
+			deadline = s_ExclusiveIrqLease.deadline;
+	}
+	
+	RecursiveLock_Unlock(&g_ExclusiveIRQLock);
+	
+	return deadline;
+}
+
+bool mcuQueueExclusiveIrqs(u32 received_irqs, s64 tick)
+{
+	bool queued = false;
+	
+	RecursiveLock_Lock(&g_ExclusiveIRQLock);
+	
+	if (s_ExclusiveIrqLease.active) {
+		u32 index = s_ExclusiveIrqLease.queued;
+		
+		/* out of room: fold into the newest entry so nothing is dropped */
+		if (index == EXCLUSIVE_IRQ_QUEUE_SIZE) {
+			s_ExclusiveIrqLease.queue[index - 1].irqs |= received_irqs;
+		} else {
+			s_ExclusiveIrqLease.queue[index].irqs = received_irqs;
+			s_ExclusiveIrqLease.queue[index].tick = tick;
+			s_ExclusiveIrqLease.queued++;
+		}
+		
+		queued = true;
+	}
+	
+	RecursiveLock_Unlock(&g_ExclusiveIRQLock);
+	
+	return queued;
+}
+
 // reg wrappers
 
 #define L(func, ...) lock ? func ## _l(__VA_ARGS__) : func(__VA_ARGS__)
@@ -274,6 +586,9 @@ static Result _mcuUpdateFirmware(const void *payload, u32 payload_size)
 
 Result mcuUpdateFirmware(const void *payload, u32 payload_size, bool locked)
 {
+	/* the new firmware starts over with its own state, the caller takes a new snapshot */
+	mcuDropRegisterSnapshot();
+	
 	if (locked) {
 		I2C_LOCKED_R(
 			_mcuUpdateFirmware(payload, payload_size)
@@ -293,6 +608,19 @@ inline Result mcuReadFwVerLow(u8 *out_value, bool lock)
 	return L(mcuReadRegisterBuffer8, MCUREG_VERSION_LOW, out_value, sizeof(u8));
 }
 
+/* both halves in one transaction */
+inline Result mcuReadFwVersion(u8 *out_high, u8 *out_low, bool lock)
+{
+	u8 data[2] = { 0, 0 };
+	
+	Result res = L(mcuReadRegisterBuffer8, MCUREG_VERSION_HIGH, &data, sizeof(data));
+	if (R_FAILED(res)) return res;
+	
+	*out_high = data[0];
+	*out_low = data[1];
+	return res;
+}
+
 inline Result mcuGetResetEventFlags(u8 *out_value, bool lock)
 {
 	return L(mcuReadRegisterBuffer8, MCUREG_RESET_EVENTS, out_value, sizeof(u8));
@@ -318,9 +646,75 @@ inline Result mcuRead3dSliderPosition(u8 *out_pos, bool lock)
 	return L(mcuReadRegisterBuffer8, MCUREG_3D_SLIDER_POSITION, out_pos, sizeof(u8));
 }
 
+/* volume slider, refreshed on MCUINT_VOL_SLIDER instead of being polled */
+static struct {
+	bool valid;
+	u8 raw;
+	u8 level;
+	u8 calibration_min;
+	u8 calibration_max;
+} s_VolumeSlider;
+
+static void updateVolumeLevel()
+{
+	u8 min = s_VolumeSlider.calibration_min;
+	u8 max = s_VolumeSlider.calibration_max;
+	u8 raw = s_VolumeSlider.raw;
+	
+	if (max <= min || raw >= max)
+		s_VolumeSlider.level = raw > min ? VOLUME_LEVEL_MAX : 0;
+	else if (raw <= min)
+		s_VolumeSlider.level = 0;
+	else
+		s_VolumeSlider.level = (u8)udiv32((u32)(raw - min) * VOLUME_LEVEL_MAX, max - min);
+	
+	mcuPublishVolumeSlider(raw, s_VolumeSlider.level);
+}
+
+Result mcuRefreshVolumeSlider(bool lock)
+{
+	u8 raw = 0;
+	
+	Result res = L(mcuReadRegisterBuffer8, MCUREG_VOLUME_SLIDER_POSITION, &raw, sizeof(u8));
+	if (R_FAILED(res)) return res;
+	
+	s_VolumeSlider.raw = raw;
+	updateVolumeLevel();
+	s_VolumeSlider.valid = true;
+	return res;
+}
+
+Result mcuLoadVolumeCalibration(bool lock)
+{
+	u8 min = 0, max = 0;
+	
+	Result res = mcuGetVolumeCalibration(&min, &max, lock);
+	if (R_FAILED(res)) return res;
+	
+	s_VolumeSlider.calibration_min = min;
+	s_VolumeSlider.calibration_max = max;
+	updateVolumeLevel();
+	return res;
+}
+
 inline Result mcuReadVolumeSliderPositiion(u8 *out_pos, bool lock)
 {
-	return L(mcuReadRegisterBuffer8, MCUREG_VOLUME_SLIDER_POSITION, out_pos, sizeof(u8));
+	if (!s_VolumeSlider.valid) {
+		Result res = mcuRefreshVolumeSlider(lock);
+		if (R_FAILED(res)) return res;
+	}
+	
+	*out_pos = s_VolumeSlider.raw;
+	return 0;
+}
+
+inline Result mcuGetVolumeLevel(u8 *out_level, u8 *out_raw, bool lock)
+{
+	Result res = mcuReadVolumeSliderPositiion(out_raw, lock);
+	if (R_FAILED(res)) return res;
+	
+	*out_level = s_VolumeSlider.level;
+	return res;
 }
 
 inline Result mcuSetBacklightPowerState(u8 top_bl_on, u8 bottom_bl_on, bool lock)
@@ -350,10 +744,85 @@ inline Result mcuSetLcdPowerState(u8 state, bool lock)
 	return L(mcuWriteRegisterBuffer8, MCUREG_LCD_PWR_CTL, &trigger, sizeof(u8));
 }
 
-inline Result mcuReset(bool lock)
+/* MCU_LCDPWR_* triggers are acknowledged by the MCUINT_VIDEO_* IRQ in the same bit order */
+#define LCDPWR_ACK_IRQS(triggers) ((u32)(triggers) << 24)
+
+/*
+	Brings the LCD power and both backlights to the given state with a single
+	MCUREG_LCD_PWR_CTL write, leaving out whatever already is in that state,
+	then waits until every trigger that went out has been acknowledged or the
+	timeout passes. Serialized, so concurrent callers can't take each other's
+	acknowledgements. The acknowledgements are queued while an exclusive IRQ
+	lease is held, so that fails right away instead of timing out.
+*/
+Result mcuSequenceLcdPower(bool lcd_on, bool top_bl_on, bool bottom_bl_on, u32 timeout_ms, u32 *out_acked_irqs, u32 *out_latency_us)
 {
-	u8 value = 'r'; // 0x78
-	return L(mcuWriteRegisterBuffer8, MCUREG_MCU_RESET_CTL, &value, sizeof(u8));
+	u8 power_status = 0;
+	u8 triggers = 0;
+	u32 acked = 0;
+	Result res;
+	
+	RecursiveLock_Lock(&g_ExclusiveIRQLock);
+	bool leased = s_ExclusiveIrqLease.active;
+	RecursiveLock_Unlock(&g_ExclusiveIRQLock);
+	
+	if (leased) {
+		*out_acked_irqs = 0;
+		*out_latency_us = 0;
+		return MCU_EXCLUSIVE_IRQ_BUSY;
+	}
+	
+	RecursiveLock_Lock(&g_LcdSequenceLock);
+	
+	s64 start = svcGetSystemTick();
+	s64 deadline = start + MS_TO_TICKS(MIN(timeout_ms, LCD_SEQUENCE_MAX_TIMEOUT_MS));
+	
+	I2C_LOCKED(
+		res = mcuGetPowerStatus(&power_status, NOLOCK);
+		
+		if (R_SUCCEEDED(res)) {
+			if (lcd_on != CHECKBIT(power_status, MCU_PWRSTAT_LCD_ON))
+				triggers |= lcd_on ? MCU_LCDPWR_POWER_ON : MCU_LCDPWR_POWER_OFF;
+			
+			if (top_bl_on != CHECKBIT(power_status, MCU_PWRSTAT_TOP_BL_ON))
+				triggers |= top_bl_on ? MCU_LCDPWR_TOP_BL_ON : MCU_LCDPWR_TOP_BL_OFF;
+			
+			if (bottom_bl_on != CHECKBIT(power_status, MCU_PWRSTAT_BOTTOM_BL_ON))
+				triggers |= bottom_bl_on ? MCU_LCDPWR_BOTTOM_BL_ON : MCU_LCDPWR_BOTTOM_BL_OFF;
+			
+			/* whatever is left over from earlier writes must not count for this one */
+			s_LcdAcks &= ~LCDPWR_ACK_IRQS(triggers);
+			
+			if (triggers)
+				res = mcuWriteRegisterBuffer8(MCUREG_LCD_PWR_CTL, &triggers, sizeof(u8));
+		}
+	)
+	
+	while (R_SUCCEEDED(res) && acked != LCDPWR_ACK_IRQS(triggers)) {
+		I2C_LOCKED(
+			acked |= s_LcdAcks & LCDPWR_ACK_IRQS(triggers);
+			s_LcdAcks &= ~LCDPWR_ACK_IRQS(triggers);
+		)
+		
+		if (acked == LCDPWR_ACK_IRQS(triggers))
+			break;
+		
+		s64 now = svcGetSystemTick();
+		
+		if (now >= deadline) {
+			res = MCU_LCD_ACK_TIMEOUT;
+			break;
+		}
+		
+		res = svcWaitSynchronization(g_LcdAckEvent, TICKS_TO_NS(deadline - now));
+	}
+	
+	*out_acked_irqs = acked;
+	*out_latency_us = TICKS_TO_US(svcGetSystemTick() - start);
+	
+	RecursiveLock_Unlock(&g_LcdSequenceLock);
+	
+	return res;
 }
 
 inline Result mcuSetForceShutdownDelay(u8 value, bool lock)
@@ -432,7 +901,12 @@ inline Result mcuGetWlanLedState(u8 *out_state, bool lock)
 
 inline Result mcuSetLedState(u8 led_regid, u8 state, bool lock)
 {
-	return L(mcuWriteRegisterBuffer8, led_regid, &state, sizeof(u8));
+	Result res = L(mcuWriteRegisterBuffer8, led_regid, &state, sizeof(u8));
+	
+	if (R_SUCCEEDED(res))
+		mcuPublishLedState(led_regid, state);
+	
+	return res;
 }
 
 inline Result mcuGetLedState(u8 led_regid, u8 *out_state, bool lock)
@@ -440,14 +914,94 @@ inline Result mcuGetLedState(u8 led_regid, u8 *out_state, bool lock)
 	return L(mcuReadRegisterBuffer8, led_regid, out_state, sizeof(u8));
 }
 
+/* power LED mode and blink pattern the MCU has, so a pattern write doesn't have to read the mode back first; under g_I2CLock */
+static struct {
+	bool mode_valid;
+	MCU_PowerLedConfig config;
+} s_PowerLed;
+
+static Result _mcuSetPowerLedState(u8 state)
+{
+	Result res = mcuWriteRegisterBuffer8(MCUREG_POWER_LED_STATE, &state, sizeof(u8));
+	
+	s_PowerLed.mode_valid = R_SUCCEEDED(res);
+	s_PowerLed.config.mode = state;
+	
+	if (R_SUCCEEDED(res))
+		mcuPublishLedState(MCUREG_POWER_LED_STATE, state);
+	
+	return res;
+}
+
+inline Result mcuSetPowerLedState(u8 state, bool lock)
+{
+	if (lock) {
+		I2C_LOCKED_R(
+			_mcuSetPowerLedState(state)
+		);
+	}
+	
+	return _mcuSetPowerLedState(state);
+}
+
+static Result _mcuGetPowerLedState(u8 *out_state)
+{
+	if (!s_PowerLed.mode_valid) {
+		Result res = mcuReadRegisterBuffer8(MCUREG_POWER_LED_STATE, &s_PowerLed.config.mode, sizeof(u8));
+		if (R_FAILED(res)) return res;
+		
+		s_PowerLed.mode_valid = true;
+	}
+	
+	*out_state = s_PowerLed.config.mode;
+	return 0;
+}
+
+inline Result mcuGetPowerLedState(u8 *out_state, bool lock)
+{
+	if (lock) {
+		I2C_LOCKED_R(
+			_mcuGetPowerLedState(out_state)
+		);
+	}
+	
+	return _mcuGetPowerLedState(out_state);
+}
+
+static Result _mcuSetPowerLedConfig(const MCU_PowerLedConfig *config)
+{
+	Result res = mcuWriteRegisterBuffer8(MCUREG_POWER_LED_STATE, config, sizeof(MCU_PowerLedConfig));
+	
+	s_PowerLed.mode_valid = R_SUCCEEDED(res);
+	_memcpy(&s_PowerLed.config, config, sizeof(MCU_PowerLedConfig));
+	
+	if (R_SUCCEEDED(res))
+		mcuPublishLedState(MCUREG_POWER_LED_STATE, config->mode);
+	
+	return res;
+}
+
+inline Result mcuSetPowerLedConfig(const MCU_PowerLedConfig *config, bool lock)
+{
+	if (lock) {
+		I2C_LOCKED_R(
+			_mcuSetPowerLedConfig(config)
+		);
+	}
+	
+	return _mcuSetPowerLedConfig(config);
+}
+
 static Result _mcuSetPowerLedBlinkPattern(u32 blink_pattern)
 {
 	MCU_PowerLedConfig config = { 0 };
-	Result res = mcuReadRegisterBuffer8(MCUREG_POWER_LED_STATE, &config.mode, sizeof(u8));
+	
+	/* only the first write after boot (or a failed one) has to ask the MCU for the mode */
+	Result res = _mcuGetPowerLedState(&config.mode);
 	if (R_FAILED(res)) return res;
 	
 	config.blink_pattern = blink_pattern;
-	return mcuWriteRegisterBuffer8(MCUREG_POWER_LED_STATE, &config, sizeof(MCU_PowerLedConfig));
+	return _mcuSetPowerLedConfig(&config);
 }
 
 inline Result mcuSetPowerLedBlinkPattern(u32 blink_pattern, bool lock)
@@ -461,14 +1015,117 @@ inline Result mcuSetPowerLedBlinkPattern(u32 blink_pattern, bool lock)
 	return _mcuSetPowerLedBlinkPattern(blink_pattern);
 }
 
+/* last notification LED data the MCU got, so that repeated uploads don't go over the bus again; under g_I2CLock */
+static struct {
+	bool valid;
+	u32 pattern_hash;
+	MCU_NotificationLedData data;
+	MCU_NotificationLedStats stats;
+} s_NotificationLed;
+
+#define NOTIFICATION_LED_PATTERN_SIZE (sizeof(MCU_NotificationLedData) - sizeof(MCU_NotifictationLedAnimation))
+
+/* FNV-1a over the three colour patterns */
+static u32 hashNotificationLedPattern(const MCU_NotificationLedData *data)
+{
+	const u8 *bytes = data->red_pattern;
+	u32 hash = 2166136261u;
+	
+	for (u32 i = 0; i < NOTIFICATION_LED_PATTERN_SIZE; i++)
+		hash = (hash ^ bytes[i]) * 16777619u;
+	
+	return hash;
+}
+
+static bool bytesEqual(const void *a, const void *b, u32 size)
+{
+	for (u32 i = 0; i < size; i++)
+		if (((const u8 *)a)[i] != ((const u8 *)b)[i])
+			return false;
+	
+	return true;
+}
+
+static Result _mcuSetNotificationLedData(MCU_NotificationLedData *data)
+{
+	u32 hash = hashNotificationLedPattern(data);
+	Result res;
+	
+	/* a loop delay of 0xFF plays the pattern once, uploading it again is what replays it, so that always goes out in full */
+	bool same_pattern = data->animation.loop_delay != 0xFF && s_NotificationLed.valid && hash == s_NotificationLed.pattern_hash &&
+	                    bytesEqual(data->red_pattern, s_NotificationLed.data.red_pattern, NOTIFICATION_LED_PATTERN_SIZE);
+	
+	if (same_pattern) {
+		if (bytesEqual(&data->animation, &s_NotificationLed.data.animation, sizeof(MCU_NotifictationLedAnimation))) {
+			s_NotificationLed.stats.skipped++;
+			s_NotificationLed.stats.bytes_saved += sizeof(MCU_NotificationLedData);
+			return 0;
+		}
+		
+		/* the patterns stay, only the 4 byte header needs to go out */
+		res = mcuWriteRegisterBuffer8(MCUREG_NOTIFICATION_LED_STATE, &data->animation, sizeof(MCU_NotifictationLedAnimation));
+		
+		if (R_SUCCEEDED(res)) {
+			s_NotificationLed.stats.animation_only++;
+			s_NotificationLed.stats.bytes_saved += NOTIFICATION_LED_PATTERN_SIZE;
+		}
+	} else {
+		res = mcuWriteRegisterBuffer(MCUREG_NOTIFICATION_LED_STATE, data, sizeof(MCU_NotificationLedData));
+		
+		if (R_SUCCEEDED(res))
+			s_NotificationLed.stats.uploads++;
+	}
+	
+	/* if a write failed, there is no telling what the MCU has now */
+	s_NotificationLed.valid = R_SUCCEEDED(res);
+	
+	if (R_SUCCEEDED(res)) {
+		_memcpy(&s_NotificationLed.data, data, sizeof(MCU_NotificationLedData));
+		s_NotificationLed.pattern_hash = hash;
+	}
+	
+	return res;
+}
+
 inline Result mcuSetNotificationLedData(MCU_NotificationLedData *data, bool lock)
 {
-	return L(mcuWriteRegisterBuffer, MCUREG_NOTIFICATION_LED_STATE, data, sizeof(MCU_NotificationLedData));
+	if (lock) {
+		I2C_LOCKED_R(
+			_mcuSetNotificationLedData(data)
+		);
+	}
+	
+	return _mcuSetNotificationLedData(data);
+}
+
+static Result _mcuSetNotificationLedAnimation(MCU_NotifictationLedAnimation *animation)
+{
+	Result res = mcuWriteRegisterBuffer8(MCUREG_NOTIFICATION_LED_STATE, animation, sizeof(MCU_NotifictationLedAnimation));
+	
+	if (R_SUCCEEDED(res))
+		_memcpy(&s_NotificationLed.data.animation, animation, sizeof(MCU_NotifictationLedAnimation));
+	else
+		s_NotificationLed.valid = false;
+	
+	return res;
 }
 
 inline Result mcuSetNotificationLedAnimation(MCU_NotifictationLedAnimation *animation, bool lock)
 {
-	return L(mcuWriteRegisterBuffer8, MCUREG_NOTIFICATION_LED_STATE, animation, sizeof(MCU_NotifictationLedAnimation));
+	if (lock) {
+		I2C_LOCKED_R(
+			_mcuSetNotificationLedAnimation(animation)
+		);
+	}
+	
+	return _mcuSetNotificationLedAnimation(animation);
+}
+
+void mcuGetNotificationLedStats(MCU_NotificationLedStats *out_stats)
+{
+	I2C_LOCKED(
+		_memcpy32_aligned(out_stats, &s_NotificationLed.stats, sizeof(MCU_NotificationLedStats))
+	)
 }
 
 inline Result mcuGetNotificationLedCycleState(u8 *out_state, bool lock)
@@ -476,6 +1133,40 @@ inline Result mcuGetNotificationLedCycleState(u8 *out_state, bool lock)
 	return L(mcuReadRegisterBuffer8, MCUREG_NOTIFICATION_LED_CYCLE_STATE, out_state, sizeof(u8));
 }
 
+static Result _mcuReset()
+{
+	u8 value = 'r'; // 0x78
+	
+	/* the MCU starts over with its own state, same as after a firmware update */
+	mcuDropRegisterSnapshot();
+	
+	/* ...and a dark notification LED, so the next upload can't be skipped as a repeat, and its own power LED mode */
+	s_NotificationLed.valid = false;
+	s_PowerLed.mode_valid = false;
+	
+	Result res = mcuWriteRegisterBuffer8(MCUREG_MCU_RESET_CTL, &value, sizeof(u8));
+	
+	if (R_SUCCEEDED(res)) {
+		svcSleepThread(1000000000LL); // wait 1 second for the mcu to get back on its feet
+		
+		/* whatever can't be read back stays cold and keeps going to the bus */
+		mcuTakeRegisterSnapshot();
+	}
+	
+	return res;
+}
+
+inline Result mcuReset(bool lock)
+{
+	if (lock) {
+		I2C_LOCKED_R(
+			_mcuReset()
+		);
+	}
+	
+	return _mcuReset();
+}
+
 inline Result mcuSetRtcTime(MCU_RtcData *data, bool lock)
 {
 	data->second = INT2BCD(data->second);
@@ -504,6 +1195,52 @@ inline Result mcuGetRtcTime(MCU_RtcData *out_data, bool lock)
 	return res;
 }
 
+/* seconds since 2000-01-01 00:00:00 */
+u32 mcuRtcSeconds(const MCU_RtcData *time)
+{
+	return ((daysSince2000(time->year, time->month, time->monthday) * 24 + time->hour) * 60 + time->minute) * 60 + time->second;
+}
+
+Result mcuGetRtcSeconds(u32 *out_seconds, bool lock)
+{
+	MCU_RtcData now;
+	
+	Result res = mcuGetRtcTime(&now, lock);
+	if (R_FAILED(res)) return res;
+	
+	*out_seconds = mcuRtcSeconds(&now);
+	return res;
+}
+
+/* one transaction, so nothing in it can tear across a second rollover */
+inline Result mcuReadClockSnapshot(MCU_ClockSnapshot *out_snapshot, bool lock)
+{
+	u8 raw[MCUREG_TICK_COUNTER_MSB - MCUREG_RTC_TIME_SECOND + 1];
+	
+	Result res = L(mcuReadRegisterBuffer8, MCUREG_RTC_TIME_SECOND, raw, sizeof(raw));
+	out_snapshot->tick = svcGetSystemTick();
+	if (R_FAILED(res)) return res;
+	
+	/* time and alarm are BCD, the correction (0x37) and tick counter are not */
+	u8 *time = (u8 *)&out_snapshot->time;
+	u8 *alarm = (u8 *)&out_snapshot->alarm;
+	
+	for (u32 i = 0; i < MCUREG_TICK_COUNTER_LSB - MCUREG_RTC_TIME_SECOND; i++) {
+		u8 reg = MCUREG_RTC_TIME_SECOND + i;
+		
+		if (reg < MCUREG_RTC_TIME_CORRECTION)
+			time[i] = BCD2INT(raw[i]);
+		else if (reg >= MCUREG_RTC_ALARM_MINUTE)
+			alarm[reg - MCUREG_RTC_ALARM_MINUTE] = BCD2INT(raw[i]);
+	}
+	
+	out_snapshot->correction = raw[MCUREG_RTC_TIME_CORRECTION - MCUREG_RTC_TIME_SECOND];
+	out_snapshot->reserved = 0;
+	out_snapshot->tick_counter = raw[MCUREG_TICK_COUNTER_LSB - MCUREG_RTC_TIME_SECOND] |
+	                             raw[MCUREG_TICK_COUNTER_MSB - MCUREG_RTC_TIME_SECOND] << 8;
+	return res;
+}
+
 Result mcuSetRtcTimeField(u8 field_regid, u8 value, bool lock)
 {
 	value = INT2BCD(value);
@@ -755,6 +1492,45 @@ inline Result mcuReadAccelerometerData(MCU_AccelerometerData *out_data, bool loc
 	return res;
 }
 
+static MCU_HidFrame s_LastHidFrame;
+
+static Result _mcuReadHidFrame(MCU_HidFrame *out_frame, s64 max_age)
+{
+	/* a recent enough frame is handed out again without touching the bus */
+	if (max_age > 0 && s_LastHidFrame.tick && svcGetSystemTick() - s_LastHidFrame.tick < max_age) {
+		_memcpy(out_frame, &s_LastHidFrame, sizeof(MCU_HidFrame));
+		return 0;
+	}
+	
+	/* the sliders are adjacent, but the IRQ registers between them and the accelerometer are cleared on read */
+	u8 sliders[2] = { 0, 0 };
+	Result res = mcuReadRegisterBuffer8(MCUREG_3D_SLIDER_POSITION, sliders, sizeof(sliders));
+	if (R_FAILED(res)) return res;
+	
+	MCU_AccelerometerData accel;
+	res = mcuReadAccelerometerData(&accel, NOLOCK);
+	if (R_FAILED(res)) return res;
+	
+	s_LastHidFrame.tick = svcGetSystemTick();
+	s_LastHidFrame.slider_3d = sliders[0];
+	s_LastHidFrame.volume_slider = sliders[1];
+	s_LastHidFrame.accel = accel;
+	
+	_memcpy(out_frame, &s_LastHidFrame, sizeof(MCU_HidFrame));
+	return res;
+}
+
+inline Result mcuReadHidFrame(MCU_HidFrame *out_frame, s64 max_age, bool lock)
+{
+	if (lock) {
+		I2C_LOCKED_R(
+			_mcuReadHidFrame(out_frame, max_age)
+		);
+	}
+	
+	return _mcuReadHidFrame(out_frame, max_age);
+}
+
 inline Result mcuSetPedometerWrapTimeMinute(u8 value, bool lock)
 {
 	value = INT2BCD(value);
@@ -787,7 +1563,13 @@ inline Result mcuSetVolumeCalibration(u8 min, u8 max, bool lock)
 {
 	u8 data[2] = { min, max };
 	
-	return L(mcuWriteRegisterBuffer8, MCUREG_VOLUME_CALIBRATION_MIN, &data, sizeof(data));
+	Result res = L(mcuWriteRegisterBuffer8, MCUREG_VOLUME_CALIBRATION_MIN, &data, sizeof(data));
+	if (R_FAILED(res)) return res;
+	
+	s_VolumeSlider.calibration_min = min;
+	s_VolumeSlider.calibration_max = max;
+	updateVolumeLevel();
+	return res;
 }
 
 inline Result mcuGetVolumeCalibration(u8 *out_min, u8 *out_max, bool lock)
@@ -804,6 +1586,10 @@ inline Result mcuGetVolumeCalibration(u8 *out_min, u8 *out_max, bool lock)
 
 static Result _mcuReadStorageArea(u8 offset, void *outbuf, u32 size)
 {
+	/* saves the offset write as well */
+	if (mcuReadStorageSnapshot(offset, outbuf, size))
+		return 0;
+	
 	Result res = mcuWriteRegisterBuffer8(MCUREG_STORAGE_AREA_OFFSET, &offset, sizeof(u8));
 	
 	if (R_FAILED(res))
@@ -878,6 +1664,32 @@ inline Result mcuGetFirmFlag(bool *out_is_set, u8 flag, bool lock)
 	return res;
 }
 
+/* get and clear in one go, the storage area is only written back if the flag was actually set */
+static Result _mcuTakeFirmFlag(bool *out_was_set, u8 flag)
+{
+	u8 firmflags = 0;
+	
+	Result res = mcuReadStorageArea(offsetof(MCU_StorageArea, firm_flags), &firmflags, sizeof(u8), NOLOCK);
+	if (R_FAILED(res)) return res;
+	
+	*out_was_set = CHECKBIT(firmflags, flag);
+	if (!*out_was_set) return res;
+	
+	firmflags &= (~flag);
+	return mcuWriteStorageArea(offsetof(MCU_StorageArea, firm_flags), &firmflags, sizeof(u8), NOLOCK);
+}
+
+inline Result mcuTakeFirmFlag(bool *out_was_set, u8 flag, bool lock)
+{
+	if (lock) {
+		I2C_LOCKED_R(
+			_mcuTakeFirmFlag(out_was_set, flag)
+		);
+	}
+	
+	return _mcuTakeFirmFlag(out_was_set, flag);
+}
+
 inline Result mcuReadInfoRegisters(void *outbuf, u32 size, bool lock)
 {
 	return L(mcuReadRegisterBuffer8, MCUREG_INFO, outbuf, size);
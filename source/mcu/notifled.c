@@ -0,0 +1,342 @@
+#include <3ds/synchronization.h>
+#include <mcu/notifled.h>
+#include <mcu/globals.h>
+#include <3ds/result.h>
+#include <3ds/err.h>
+#include <3ds/svc.h>
+#include <mcu/mcu.h>
+#include <memops.h>
+#include <util.h>
+
+/*
+	Notification LED compositor. Every client gets one layer with a priority,
+	an optional expiry and its own precomputed MCU_NotificationLedData. Only
+	the winning layer (highest priority, the most recently changed one on a
+	tie) ever reaches the MCU, and only when the winner changes, so clients no
+	longer fight over MCUREG_NOTIFICATION_LED_STATE. With no layer left the LED
+	is switched off. Under g_I2CLock, like the upload itself.
+*/
+typedef struct NotificationLedLayer {
+	void *owner;
+	u8 priority;
+	u32 serial; /* bumped on every change */
+	s64 expiry; /* system tick, 0 to stay until cleared */
+	MCU_NotificationLedData data;
+} NotificationLedLayer;
+
+static struct {
+	NotificationLedLayer layers[NOTIFICATION_LED_LAYER_COUNT];
+	u32 next_serial;
+	u32 shown_serial; /* serial of the layer the MCU is showing, 0 for none */
+} s_Layers;
+
+static MCU_NotificationLedData s_LedOff;
+
+/* expanded MCU_NotificationLedPattern descriptors, also under g_I2CLock */
+static struct {
+	struct {
+		bool valid;
+		u32 last_used;
+		MCU_NotificationLedPattern pattern;
+		MCU_NotificationLedData data;
+	} entries[NOTIFICATION_LED_PATTERN_CACHE_SIZE];
+	u32 clock;
+} s_PatternCache;
+
+static inline u32 nextSerial()
+{
+	if (!++s_Layers.next_serial)
+		s_Layers.next_serial = 1;
+	
+	return s_Layers.next_serial;
+}
+
+/* the owner's layer, a free one for NULL */
+static NotificationLedLayer *findLayer(void *owner)
+{
+	for (u32 i = 0; i < NOTIFICATION_LED_LAYER_COUNT; i++)
+		if (s_Layers.layers[i].owner == owner)
+			return &s_Layers.layers[i];
+	
+	return NULL;
+}
+
+static inline void freeLayer(NotificationLedLayer *layer)
+{
+	_memset32_aligned(layer, 0, sizeof(NotificationLedLayer));
+}
+
+static NotificationLedLayer *winningLayer()
+{
+	NotificationLedLayer *winner = NULL;
+	
+	for (u32 i = 0; i < NOTIFICATION_LED_LAYER_COUNT; i++) {
+		NotificationLedLayer *layer = &s_Layers.layers[i];
+		
+		if (!layer->owner)
+			continue;
+		
+		/* the serial wraps after 4 billion changes, good enough for breaking ties */
+		if (!winner || layer->priority > winner->priority ||
+		    (layer->priority == winner->priority && layer->serial > winner->serial))
+			winner = layer;
+	}
+	
+	return winner;
+}
+
+static Result composeLayers()
+{
+	NotificationLedLayer *winner = winningLayer();
+	u32 serial = winner ? winner->serial : 0;
+	
+	if (serial == s_Layers.shown_serial)
+		return 0;
+	
+	Result res = mcuSetNotificationLedData(winner ? &winner->data : &s_LedOff, NOLOCK);
+	
+	/* otherwise it's tried again with the next change */
+	if (R_SUCCEEDED(res))
+		s_Layers.shown_serial = serial;
+	
+	return res;
+}
+
+static Result _mcuSetNotificationLedLayer(void *owner, u8 priority, u32 duration_ms, const MCU_NotificationLedData *data)
+{
+	NotificationLedLayer *layer = findLayer(owner);
+	
+	if (!layer)
+		layer = findLayer(NULL);
+	
+	if (!layer)
+		return MCU_OUT_OF_SUBSCRIPTIONS;
+	
+	layer->owner = owner;
+	layer->priority = priority;
+	layer->serial = nextSerial();
+	layer->expiry = duration_ms ? svcGetSystemTick() + MS_TO_TICKS(duration_ms) : 0;
+	_memcpy(&layer->data, data, sizeof(MCU_NotificationLedData));
+	
+	return composeLayers();
+}
+
+Result mcuSetNotificationLedLayer(void *owner, u8 priority, u32 duration_ms, const MCU_NotificationLedData *data)
+{
+	Result res;
+	
+	I2C_LOCKED(
+		res = _mcuSetNotificationLedLayer(owner, priority, duration_ms, data)
+	)
+	
+	/* have the worker thread pick up the expiry */
+	if (duration_ms)
+		T(svcSignalEvent(g_WorkerEvent));
+	
+	return res;
+}
+
+static bool patternsEqual(const MCU_NotificationLedPattern *a, const MCU_NotificationLedPattern *b)
+{
+	const u8 *x = (const u8 *)a, *y = (const u8 *)b;
+	
+	for (u32 i = 0; i < sizeof(MCU_NotificationLedPattern); i++)
+		if (x[i] != y[i])
+			return false;
+	
+	return true;
+}
+
+/*
+	Brightness 0-255 at `step` of the cycle. The scales are 16.16 fixed point
+	steps to brightness factors, worked out once per pattern so there is no
+	division per step.
+*/
+static u32 waveformLevel(u8 waveform, u32 step, u32 period, u32 cycle_scale, u32 ramp_scale)
+{
+	if (period == 1)
+		return 255;
+	
+	switch (waveform) {
+	case MCU_LED_WAVE_BREATHE:
+		{
+			/* triangle over the cycle, squared so it lingers near dark like a sine does */
+			u32 position = (step * cycle_scale) >> 16;
+			u32 triangle = position < 128 ? position << 1 : (256 - position) << 1;
+			
+			triangle = MIN(triangle, 255);
+			
+			return (triangle * triangle) >> 8;
+		}
+	case MCU_LED_WAVE_BLINK:
+		return step < (period >> 1) ? 255 : 0;
+	case MCU_LED_WAVE_RAMP:
+		return (step * ramp_scale) >> 16;
+	default:
+		return 255;
+	}
+}
+
+static void generatePattern(const MCU_NotificationLedPattern *pattern, MCU_NotificationLedData *out_data)
+{
+	u32 period = pattern->period;
+	u32 lit_steps = pattern->repeats ? pattern->repeats * period : NOTIFICATION_LED_PATTERN_STEPS;
+	u32 cycle_scale = udiv32(256 << 16, period);
+	u32 ramp_scale = period > 1 ? udiv32(255 << 16, period - 1) : 0;
+	u32 step = pattern->phase;
+	
+	while (step >= period)
+		step -= period;
+	
+	_memcpy(&out_data->animation, &pattern->animation, sizeof(MCU_NotifictationLedAnimation));
+	
+	for (u32 i = 0; i < NOTIFICATION_LED_PATTERN_STEPS; i++) {
+		/* 1-256, so full brightness keeps the colour exact */
+		u32 level = i < lit_steps ? waveformLevel(pattern->waveform, step, period, cycle_scale, ramp_scale) + 1 : 0;
+		
+		out_data->red_pattern[i] = (pattern->red * level) >> 8;
+		out_data->green_pattern[i] = (pattern->green * level) >> 8;
+		out_data->blue_pattern[i] = (pattern->blue * level) >> 8;
+		
+		if (++step == period)
+			step = 0;
+	}
+}
+
+static const MCU_NotificationLedData *cachedPattern(const MCU_NotificationLedPattern *pattern)
+{
+	u32 victim = 0;
+	
+	s_PatternCache.clock++;
+	
+	for (u32 i = 0; i < NOTIFICATION_LED_PATTERN_CACHE_SIZE; i++) {
+		if (s_PatternCache.entries[i].valid && patternsEqual(&s_PatternCache.entries[i].pattern, pattern)) {
+			s_PatternCache.entries[i].last_used = s_PatternCache.clock;
+			return &s_PatternCache.entries[i].data;
+		}
+		
+		if (!s_PatternCache.entries[i].valid)
+			victim = i;
+		else if (s_PatternCache.entries[victim].valid && s_PatternCache.entries[i].last_used < s_PatternCache.entries[victim].last_used)
+			victim = i;
+	}
+	
+	generatePattern(pattern, &s_PatternCache.entries[victim].data);
+	
+	_memcpy(&s_PatternCache.entries[victim].pattern, pattern, sizeof(MCU_NotificationLedPattern));
+	s_PatternCache.entries[victim].valid = true;
+	s_PatternCache.entries[victim].last_used = s_PatternCache.clock;
+	
+	return &s_PatternCache.entries[victim].data;
+}
+
+Result mcuSetNotificationLedLayerPattern(void *owner, u8 priority, u32 duration_ms, const MCU_NotificationLedPattern *pattern)
+{
+	Result res;
+	
+	if (pattern->waveform > MCU_LED_WAVE_RAMP || !pattern->period || pattern->period > NOTIFICATION_LED_PATTERN_STEPS)
+		return MCU_OUT_OF_RANGE;
+	
+	I2C_LOCKED(
+		res = _mcuSetNotificationLedLayer(owner, priority, duration_ms, cachedPattern(pattern))
+	)
+	
+	if (duration_ms)
+		T(svcSignalEvent(g_WorkerEvent));
+	
+	return res;
+}
+
+static Result _mcuSetNotificationLedLayerAnimation(void *owner, const MCU_NotifictationLedAnimation *animation)
+{
+	NotificationLedLayer *layer = findLayer(owner);
+	
+	if (!layer) {
+		if (owner != NOTIFICATION_LED_LEGACY_OWNER)
+			return MCU_INVALID_TOKEN;
+		
+		/*
+			The original animation command may come before any pattern, it then
+			only writes the 4 byte header like it always did. Not while another
+			client's layer is showing though, that one would lose its animation;
+			a legacy pattern brings its own header anyway, so this one is dropped.
+		*/
+		if (winningLayer())
+			return 0;
+		
+		MCU_NotifictationLedAnimation header;
+		_memcpy(&header, animation, sizeof(MCU_NotifictationLedAnimation));
+		
+		return mcuSetNotificationLedAnimation(&header, NOLOCK);
+	}
+	
+	layer->serial = nextSerial();
+	_memcpy(&layer->data.animation, animation, sizeof(MCU_NotifictationLedAnimation));
+	
+	return composeLayers();
+}
+
+Result mcuSetNotificationLedLayerAnimation(void *owner, const MCU_NotifictationLedAnimation *animation)
+{
+	Result res;
+	
+	I2C_LOCKED(
+		res = _mcuSetNotificationLedLayerAnimation(owner, animation)
+	)
+	
+	return res;
+}
+
+Result mcuClearNotificationLedLayer(void *owner)
+{
+	Result res = MCU_INVALID_TOKEN;
+	
+	I2C_LOCKED(
+		NotificationLedLayer *layer = findLayer(owner);
+		
+		if (owner && layer) {
+			freeLayer(layer);
+			res = composeLayers();
+		}
+	)
+	
+	return res;
+}
+
+/* the LED can't be left showing the pattern of a client that's gone, a failed upload is simply retried with the next change */
+void mcuReleaseNotificationLedLayers(void *owner)
+{
+	mcuClearNotificationLedLayer(owner);
+}
+
+/* drops expired layers, returns the nearest expiry left, 0 if there is none */
+s64 mcuRunNotificationLedLayers(s64 now)
+{
+	s64 next = 0;
+	
+	I2C_LOCKED(
+		bool changed = false;
+		
+		for (u32 i = 0; i < NOTIFICATION_LED_LAYER_COUNT; i++) {
+			NotificationLedLayer *layer = &s_Layers.layers[i];
+			
+			if (!layer->owner || !layer->expiry)
+				continue;
+			
+			if (now < layer->expiry) {
+				if (!next || layer->expiry < next)
+					next = layer->expiry;
+				
+				continue;
+			}
+			
+			freeLayer(layer);
+			changed = true;
+		}
+		
+		if (changed)
+			composeLayers();
+	)
+	
+	return next;
+}
@@ -0,0 +1,547 @@
+#include <3ds/synchronization.h>
+#include <mcu/pedometer.h>
+#include <mcu/globals.h>
+#include <3ds/result.h>
+#include <3ds/err.h>
+#include <3ds/svc.h>
+#include <mcu/mcu.h>
+#include <memops.h>
+#include <util.h>
+
+/*
+	Copy of the MCU step history, so that a read only has to transfer what changed
+	since the last one. MCUREG_PEDOMETER_STEP_DATA streams the (BCD) timestamp
+	header followed by the hourly counts, newest (the header hour) first, so a
+	short read of the header plus the first count works as a probe and the hours
+	that rolled over since can be refetched as a prefix.
+	
+	Slots are indexed by absolute hour modulo PEDOMETER_HOURS, and each one
+	remembers the generation it last changed in. Only touched with g_I2CLock held.
+*/
+static struct {
+	bool valid;
+	u32 hour; /* absolute hour of stepcounts[0] */
+	u32 generation;
+	struct MCU_PedometerTime time;
+	u16 steps[PEDOMETER_HOURS];
+	u32 generations[PEDOMETER_HOURS];
+} s_Pedometer;
+
+static inline u32 pedometerAbsoluteHour(const struct MCU_PedometerTime *time)
+{
+	return daysSince2000(time->year, time->month, time->monthday) * 24 + time->hour;
+}
+
+static inline u32 pedometerSlot(u32 hour)
+{
+	return hour % PEDOMETER_HOURS;
+}
+
+static void decodePedometerTime(struct MCU_PedometerTime *time)
+{
+	time->hour = BCD2INT(time->hour);
+	time->monthday = BCD2INT(time->monthday);
+	time->month = BCD2INT(time->month);
+	time->year = BCD2INT(time->year);
+	time->minute = BCD2INT(time->minute);
+	time->second = BCD2INT(time->second);
+}
+
+/* scratch space for refreshes, too big for the session thread stacks */
+static MCU_PedometerStepData s_PedometerData;
+
+/* reads the header and the newest `hours` counts, and stores whatever differs from the cache */
+static Result refreshPedometerPrefix(u32 hours, bool full)
+{
+	MCU_PedometerStepData *data = &s_PedometerData;
+	
+	Result res = mcuReadRegisterBuffer(MCUREG_PEDOMETER_STEP_DATA, data, sizeof(struct MCU_PedometerTime) + hours * sizeof(u16));
+	if (R_FAILED(res)) return res;
+	
+	decodePedometerTime(&data->pedometer_time);
+	
+	u32 hour = pedometerAbsoluteHour(&data->pedometer_time);
+	
+	/* the header moved again since the probe and the prefix no longer reaches the cached hours */
+	if (!full && (hour < s_Pedometer.hour || hour - s_Pedometer.hour >= hours))
+		return refreshPedometerPrefix(PEDOMETER_HOURS, true);
+	
+	u32 generation = s_Pedometer.generation + 1;
+	bool changed = false;
+	
+	/* all but the oldest hour of the prefix are new hours, reusing the slot of the same hour a week earlier */
+	for (u32 i = 0; i < hours; i++) {
+		u32 slot = pedometerSlot(hour - i);
+		
+		if (full || i + 1 < hours || s_Pedometer.steps[slot] != data->stepcounts[i]) {
+			s_Pedometer.steps[slot] = data->stepcounts[i];
+			s_Pedometer.generations[slot] = generation;
+			changed = true;
+		}
+	}
+	
+	_memcpy(&s_Pedometer.time, &data->pedometer_time, sizeof(struct MCU_PedometerTime));
+	s_Pedometer.hour = hour;
+	s_Pedometer.valid = true;
+	
+	if (changed)
+		s_Pedometer.generation = generation;
+	
+	return res;
+}
+
+static Result refreshPedometerCache()
+{
+	if (!s_Pedometer.valid)
+		return refreshPedometerPrefix(PEDOMETER_HOURS, true);
+	
+	/* probe: header and the newest count */
+	struct {
+		struct MCU_PedometerTime time;
+		u16 steps;
+	} probe;
+	
+	Result res = mcuReadRegisterBuffer(MCUREG_PEDOMETER_STEP_DATA, &probe, sizeof(probe));
+	if (R_FAILED(res)) return res;
+	
+	decodePedometerTime(&probe.time);
+	
+	u32 hour = pedometerAbsoluteHour(&probe.time);
+	
+	if (hour == s_Pedometer.hour) {
+		u32 slot = pedometerSlot(hour);
+		
+		_memcpy(&s_Pedometer.time, &probe.time, sizeof(struct MCU_PedometerTime));
+		
+		if (s_Pedometer.steps[slot] != probe.steps) {
+			s_Pedometer.steps[slot] = probe.steps;
+			s_Pedometer.generations[slot] = ++s_Pedometer.generation;
+		}
+		
+		return res;
+	}
+	
+	/* new hour(s): refetch those plus the previous newest one, which may have gained steps before the rollover */
+	if (hour > s_Pedometer.hour && hour - s_Pedometer.hour < PEDOMETER_HOURS)
+		return refreshPedometerPrefix(hour - s_Pedometer.hour + 1, false);
+	
+	return refreshPedometerPrefix(PEDOMETER_HOURS, true);
+}
+
+static Result _mcuReadPedometerStepDataCached(MCU_PedometerStepData *out_data)
+{
+	Result res = refreshPedometerCache();
+	if (R_FAILED(res)) return res;
+	
+	_memcpy(&out_data->pedometer_time, &s_Pedometer.time, sizeof(struct MCU_PedometerTime));
+	
+	for (u32 i = 0; i < PEDOMETER_HOURS; i++)
+		out_data->stepcounts[i] = s_Pedometer.steps[pedometerSlot(s_Pedometer.hour - i)];
+	
+	return res;
+}
+
+static Result _mcuGetPedometerChangesSince(u32 generation, MCU_PedometerBucket *out_buckets, u32 max_buckets, u32 *out_count, u32 *out_generation)
+{
+	*out_count = 0;
+	*out_generation = 0;
+	
+	Result res = refreshPedometerCache();
+	if (R_FAILED(res)) return res;
+	
+	u32 count = 0;
+	
+	/* newest first, so a caller with a short buffer gets the hours that matter most */
+	for (u32 i = 0; i < PEDOMETER_HOURS && count < max_buckets; i++) {
+		u32 hour = s_Pedometer.hour - i;
+		u32 slot = pedometerSlot(hour);
+		
+		if (s_Pedometer.generations[slot] <= generation)
+			continue;
+		
+		out_buckets[count].hour = hour;
+		out_buckets[count].steps = s_Pedometer.steps[slot];
+		out_buckets[count].reserved = 0;
+		count++;
+	}
+	
+	*out_count = count;
+	*out_generation = s_Pedometer.generation;
+	return res;
+}
+
+/*
+	Aggregation kernels over the step counts, two hours per word. With the ARMv6
+	SIMD instructions the sums use UXTAH on both halves, and the peak and active
+	hour count use USUB16 to set the GE flags per halfword and SEL to act on them.
+	GE isn't known to the compiler, so each USUB16/SEL pair stays in one asm block.
+*/
+#if defined(__ARM_FEATURE_SIMD32)
+static inline u32 sumHalves(u32 acc, u32 pair)
+{
+	__asm__ ("uxtah %0, %0, %1\n\tuxtah %0, %0, %1, ror #16" : "+r"(acc) : "r"(pair));
+	return acc;
+}
+
+static inline u32 maxHalves(u32 max, u32 pair)
+{
+	u32 out;
+	__asm__ ("usub16 %0, %2, %1\n\tsel %0, %2, %1" : "=&r"(out) : "r"(max), "r"(pair) : "cc");
+	return out;
+}
+
+static inline u32 nonZeroHalves(u32 acc, u32 pair)
+{
+	u32 out;
+	__asm__ ("usub16 %0, %1, %2\n\tsel %0, %1, %3" : "=&r"(out) : "r"(0), "r"(pair), "r"(0x00010001) : "cc");
+	__asm__ ("uadd16 %0, %0, %1" : "+r"(acc) : "r"(out));
+	return acc;
+}
+#else
+static inline u32 sumHalves(u32 acc, u32 pair)
+{
+	return acc + (pair & 0xFFFF) + (pair >> 16);
+}
+
+static inline u32 maxHalves(u32 max, u32 pair)
+{
+	u32 lo = max & 0xFFFF, hi = max >> 16;
+	
+	if ((pair & 0xFFFF) > lo)
+		lo = pair & 0xFFFF;
+	
+	if ((pair >> 16) > hi)
+		hi = pair >> 16;
+	
+	return hi << 16 | lo;
+}
+
+static inline u32 nonZeroHalves(u32 acc, u32 pair)
+{
+	return acc + ((pair & 0xFFFF) ? 1 : 0) + ((pair >> 16) ? 0x10000 : 0);
+}
+#endif
+
+/* newest first, the kernels read it as pairs through the union rather than a cast pointer */
+static union {
+	u16 hours[PEDOMETER_HOURS];
+	u32 pairs[PEDOMETER_HOURS / 2];
+} s_PedometerHours;
+static MCU_PedometerStats s_PedometerStats;
+static bool s_PedometerStatsValid;
+
+static u32 sumHours(u32 start, u32 end)
+{
+	u32 sum = 0;
+	
+	if (start >= end)
+		return 0;
+	
+	if (start & 1)
+		sum += s_PedometerHours.hours[start++];
+	
+	if ((end - start) & 1)
+		sum += s_PedometerHours.hours[--end];
+	
+	for (u32 i = start >> 1; i < end >> 1; i++)
+		sum = sumHalves(sum, s_PedometerHours.pairs[i]);
+	
+	return sum;
+}
+
+static void computePedometerStats()
+{
+	MCU_PedometerStats *stats = &s_PedometerStats;
+	
+	for (u32 i = 0; i < PEDOMETER_HOURS; i++)
+		s_PedometerHours.hours[i] = s_Pedometer.steps[pedometerSlot(s_Pedometer.hour - i)];
+	
+	u32 max = 0, active = 0;
+	
+	for (u32 i = 0; i < PEDOMETER_HOURS / 2; i++) {
+		max = maxHalves(max, s_PedometerHours.pairs[i]);
+		active = nonZeroHalves(active, s_PedometerHours.pairs[i]);
+	}
+	
+	stats->generation = s_Pedometer.generation;
+	stats->week_total = sumHours(0, PEDOMETER_HOURS);
+	u32 max_lo = max & 0xFFFF, max_hi = max >> 16;
+	
+	stats->peak_steps = (u16)MAX(max_lo, max_hi);
+	stats->active_hours = (u8)((active & 0xFFFF) + (active >> 16));
+	
+	/* today ends at the header hour, every day before it is a whole 24 hours */
+	u32 start = 0, end = s_Pedometer.time.hour + 1;
+	
+	for (u32 day = 0; day < 7; day++) {
+		stats->day_totals[day] = sumHours(start, end);
+		start = end;
+		end = MIN(end + 24, PEDOMETER_HOURS);
+	}
+	
+	stats->peak_hours_ago = 0;
+	
+	for (u32 i = 0; i < PEDOMETER_HOURS; i++) {
+		if (s_PedometerHours.hours[i] == stats->peak_steps) {
+			stats->peak_hours_ago = (u8)i;
+			break;
+		}
+	}
+	
+	s_PedometerStatsValid = true;
+}
+
+static Result _mcuGetPedometerStats(MCU_PedometerStats *out_stats)
+{
+	Result res = refreshPedometerCache();
+	if (R_FAILED(res)) return res;
+	
+	/* only recomputed once the step data actually changed */
+	if (!s_PedometerStatsValid || s_PedometerStats.generation != s_Pedometer.generation)
+		computePedometerStats();
+	
+	_memcpy32_aligned(out_stats, &s_PedometerStats, sizeof(MCU_PedometerStats));
+	return res;
+}
+
+Result mcuReadPedometerStepDataCached(MCU_PedometerStepData *out_data, bool lock)
+{
+	if (lock) {
+		I2C_LOCKED_R(
+			_mcuReadPedometerStepDataCached(out_data)
+		);
+	}
+	
+	return _mcuReadPedometerStepDataCached(out_data);
+}
+
+Result mcuGetPedometerChangesSince(u32 generation, MCU_PedometerBucket *out_buckets, u32 max_buckets, u32 *out_count, u32 *out_generation, bool lock)
+{
+	if (lock) {
+		I2C_LOCKED_R(
+			_mcuGetPedometerChangesSince(generation, out_buckets, max_buckets, out_count, out_generation)
+		);
+	}
+	
+	return _mcuGetPedometerChangesSince(generation, out_buckets, max_buckets, out_count, out_generation);
+}
+
+Result mcuGetPedometerStats(MCU_PedometerStats *out_stats, bool lock)
+{
+	if (lock) {
+		I2C_LOCKED_R(
+			_mcuGetPedometerStats(out_stats)
+		);
+	}
+	
+	return _mcuGetPedometerStats(out_stats);
+}
+
+/* the step data was cleared, next read starts over from a full one */
+void mcuInvalidatePedometerCache()
+{
+	RecursiveLock_Lock(&g_I2CLock);
+	s_Pedometer.valid = false;
+	s_PedometerStatsValid = false;
+	RecursiveLock_Unlock(&g_I2CLock);
+}
+
+/*
+	Step count subscriptions. A single read of the 24-bit step counter per poll
+	serves all of them, and only while any is armed. Also under g_I2CLock.
+*/
+static struct {
+	struct {
+		void *owner;
+		Handle event;
+		u32 target;
+		u32 delta; /* 0 for absolute goals */
+		bool armed;
+	} subscriptions[STEP_SUBSCRIPTION_COUNT];
+	u32 last_count;
+	MCU_AccelerometerData last_accel;
+	u32 interval_ms;
+	s64 next_tick;
+} s_Steps;
+
+static bool stepSubscriptionsArmed()
+{
+	for (u32 i = 0; i < STEP_SUBSCRIPTION_COUNT; i++)
+		if (s_Steps.subscriptions[i].armed)
+			return true;
+	
+	return false;
+}
+
+static void freeStepSubscription(u32 index)
+{
+	if (s_Steps.subscriptions[index].event)
+		T(svcCloseHandle(s_Steps.subscriptions[index].event));
+	
+	_memset32_aligned(&s_Steps.subscriptions[index], 0, sizeof(s_Steps.subscriptions[index]));
+}
+
+static Result _mcuSubscribeSteps(void *owner, u8 type, u32 value, u32 *out_id, Handle *out_event)
+{
+	if (type > MCU_STEPS_ABSOLUTE || (type == MCU_STEPS_DELTA && (!value || value > STEP_DELTA_MAX)))
+		return MCU_OUT_OF_RANGE;
+	
+	u32 index = 0;
+	
+	for (; index < STEP_SUBSCRIPTION_COUNT; index++)
+		if (!s_Steps.subscriptions[index].owner)
+			break;
+	
+	if (index == STEP_SUBSCRIPTION_COUNT)
+		return MCU_OUT_OF_SUBSCRIPTIONS;
+	
+	u32 count = 0;
+	
+	Result res = mcuReadPedometerStepCount(&count, NOLOCK);
+	if (R_FAILED(res)) return res;
+	
+	Handle event = 0;
+	
+	res = svcCreateEvent(&event, RESET_ONESHOT);
+	if (R_FAILED(res)) return res;
+	
+	if (!stepSubscriptionsArmed()) {
+		s_Steps.interval_ms = STEP_POLL_MIN_MS;
+		s_Steps.next_tick = 0;
+	}
+	
+	s_Steps.last_count = count;
+	s_Steps.subscriptions[index].owner = owner;
+	s_Steps.subscriptions[index].event = event;
+	s_Steps.subscriptions[index].delta = type == MCU_STEPS_DELTA ? value : 0;
+	s_Steps.subscriptions[index].target = type == MCU_STEPS_DELTA ? count + value : value;
+	s_Steps.subscriptions[index].armed = true;
+	
+	/* an absolute goal that is already met fires right away */
+	if (type == MCU_STEPS_ABSOLUTE && count >= value) {
+		s_Steps.subscriptions[index].armed = false;
+		T(svcSignalEvent(event));
+	}
+	
+	*out_id = index;
+	*out_event = event;
+	return res;
+}
+
+Result mcuSubscribeSteps(void *owner, u8 type, u32 value, u32 *out_id, Handle *out_event)
+{
+	Result res;
+	
+	I2C_LOCKED(
+		res = _mcuSubscribeSteps(owner, type, value, out_id, out_event)
+	)
+	
+	/* have the worker thread pick up the new poll deadline */
+	if (R_SUCCEEDED(res))
+		T(svcSignalEvent(g_WorkerEvent));
+	
+	return res;
+}
+
+Result mcuUnsubscribeSteps(void *owner, u32 id)
+{
+	Result res = MCU_INVALID_TOKEN;
+	
+	RecursiveLock_Lock(&g_I2CLock);
+	
+	if (id < STEP_SUBSCRIPTION_COUNT && s_Steps.subscriptions[id].owner == owner) {
+		freeStepSubscription(id);
+		res = 0;
+	}
+	
+	RecursiveLock_Unlock(&g_I2CLock);
+	
+	return res;
+}
+
+void mcuReleaseStepSubscriptions(void *owner)
+{
+	RecursiveLock_Lock(&g_I2CLock);
+	
+	for (u32 i = 0; i < STEP_SUBSCRIPTION_COUNT; i++)
+		if (s_Steps.subscriptions[i].owner == owner)
+			freeStepSubscription(i);
+	
+	RecursiveLock_Unlock(&g_I2CLock);
+}
+
+static inline bool accelerometerMoved(const MCU_AccelerometerData *a, const MCU_AccelerometerData *b)
+{
+	s32 dx = a->x - b->x, dy = a->y - b->y, dz = a->z - b->z;
+	
+	return dx > STEP_MOTION_THRESHOLD || dx < -STEP_MOTION_THRESHOLD ||
+	       dy > STEP_MOTION_THRESHOLD || dy < -STEP_MOTION_THRESHOLD ||
+	       dz > STEP_MOTION_THRESHOLD || dz < -STEP_MOTION_THRESHOLD;
+}
+
+static s64 _mcuRunStepSubscriptions(s64 now)
+{
+	if (!stepSubscriptionsArmed())
+		return 0;
+	
+	if (now < s_Steps.next_tick)
+		return s_Steps.next_tick;
+	
+	u32 count = 0;
+	T(mcuReadPedometerStepCount(&count, NOLOCK));
+	
+	for (u32 i = 0; i < STEP_SUBSCRIPTION_COUNT; i++) {
+		if (!s_Steps.subscriptions[i].armed)
+			continue;
+		
+		/* the step data got cleared, deltas count from the new zero */
+		if (count < s_Steps.last_count && s_Steps.subscriptions[i].delta)
+			s_Steps.subscriptions[i].target = count + s_Steps.subscriptions[i].delta;
+		
+		if (count < s_Steps.subscriptions[i].target)
+			continue;
+		
+		T(svcSignalEvent(s_Steps.subscriptions[i].event));
+		
+		if (s_Steps.subscriptions[i].delta) {
+			while (s_Steps.subscriptions[i].target <= count)
+				s_Steps.subscriptions[i].target += s_Steps.subscriptions[i].delta;
+		} else {
+			s_Steps.subscriptions[i].armed = false;
+		}
+	}
+	
+	/* steps, or at least motion, mean it's worth looking again soon; a device lying still can wait */
+	bool moving = count != s_Steps.last_count;
+	
+	if (!moving) {
+		MCU_AccelerometerData accel;
+		
+		if (R_SUCCEEDED(mcuReadAccelerometerData(&accel, NOLOCK))) {
+			moving = accelerometerMoved(&accel, &s_Steps.last_accel);
+			_memcpy(&s_Steps.last_accel, &accel, sizeof(MCU_AccelerometerData));
+		}
+	}
+	
+	if (moving)
+		s_Steps.interval_ms = STEP_POLL_MIN_MS;
+	else
+		s_Steps.interval_ms = MIN(s_Steps.interval_ms << 1, STEP_POLL_MAX_MS);
+	
+	s_Steps.last_count = count;
+	s_Steps.next_tick = now + MS_TO_TICKS(s_Steps.interval_ms);
+	
+	return stepSubscriptionsArmed() ? s_Steps.next_tick : 0;
+}
+
+/* polls if due, returns the tick the next poll is due at, 0 if nothing is subscribed */
+s64 mcuRunStepSubscriptions(s64 now)
+{
+	s64 next_tick;
+	
+	I2C_LOCKED(
+		next_tick = _mcuRunStepSubscriptions(now)
+	)
+	
+	return next_tick;
+}
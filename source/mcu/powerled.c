@@ -0,0 +1,100 @@
+#include <3ds/synchronization.h>
+#include <mcu/powerled.h>
+#include <mcu/coalesce.h>
+#include <mcu/globals.h>
+#include <3ds/result.h>
+#include <3ds/err.h>
+#include <3ds/svc.h>
+#include <mcu/mcu.h>
+#include <memops.h>
+#include <util.h>
+
+/*
+	Scheduled power LED sequence. The worker thread moves on to the next step
+	when the current one's time is up, so a client doesn't have to keep a
+	polling loop around just to make the LED more urgent. Any other power LED
+	write stops it. Under g_I2CLock, like the power LED cache in mcu.c.
+*/
+static struct {
+	void *owner; /* session that started it, so it ends with that session */
+	bool active;
+	u8 step;
+	s64 deadline; /* system tick, 0 while holding a step */
+	MCU_PowerLedSequence sequence;
+} s_Sequence;
+
+static void applyStep(s64 now)
+{
+	MCU_PowerLedStep *step = &s_Sequence.sequence.steps[s_Sequence.step];
+	MCU_PowerLedConfig config = { step->mode, step->blink_pattern };
+	
+	bool last = s_Sequence.step == s_Sequence.sequence.count - 1;
+	
+	/* the last step of a sequence that doesn't loop is held */
+	s_Sequence.deadline = step->duration_ms && (!last || s_Sequence.sequence.loop) ? now + MS_TO_TICKS(step->duration_ms) : 0;
+	
+	/* a failed write is simply superseded by the next step */
+	mcuSetPowerLedConfig(&config, NOLOCK);
+}
+
+Result mcuStartPowerLedSequence(void *owner, const MCU_PowerLedSequence *sequence)
+{
+	if (!sequence->count || sequence->count > POWER_LED_SEQUENCE_STEPS)
+		return MCU_OUT_OF_RANGE;
+	
+	I2C_LOCKED(
+		/* a power LED mode still held back would otherwise land on top of the sequence */
+		mcuDropCoalescedWrite(MCUREG_POWER_LED_STATE);
+		
+		_memcpy(&s_Sequence.sequence, sequence, sizeof(MCU_PowerLedSequence));
+		s_Sequence.owner = owner;
+		s_Sequence.active = true;
+		s_Sequence.step = 0;
+		applyStep(svcGetSystemTick());
+	)
+	
+	/* have the worker thread pick up the first deadline */
+	T(svcSignalEvent(g_WorkerEvent));
+	
+	return 0;
+}
+
+void mcuStopPowerLedSequence()
+{
+	I2C_LOCKED(
+		s_Sequence.owner = NULL;
+		s_Sequence.active = false;
+		s_Sequence.deadline = 0;
+	)
+}
+
+/* a sequence doesn't outlive the client that started it, the LED keeps the current step like on a stop */
+void mcuReleasePowerLedSequence(void *owner)
+{
+	I2C_LOCKED(
+		if (s_Sequence.active && s_Sequence.owner == owner) {
+			s_Sequence.owner = NULL;
+			s_Sequence.active = false;
+			s_Sequence.deadline = 0;
+		}
+	)
+}
+
+/* moves on to the next step if the current one is over, returns when that happens next, 0 if it doesn't */
+s64 mcuRunPowerLedSequence(s64 now)
+{
+	s64 next;
+	
+	I2C_LOCKED(
+		if (s_Sequence.active && s_Sequence.deadline && now >= s_Sequence.deadline) {
+			if (++s_Sequence.step == s_Sequence.sequence.count)
+				s_Sequence.step = 0;
+			
+			applyStep(now);
+		}
+		
+		next = s_Sequence.active ? s_Sequence.deadline : 0;
+	)
+	
+	return next;
+}
@@ -0,0 +1,227 @@
+#include <3ds/synchronization.h>
+#include <mcu/snapshot.h>
+#include <mcu/globals.h>
+#include <3ds/result.h>
+#include <mcu/mcu.h>
+#include <memops.h>
+#include <util.h>
+
+/*
+	Boot time copy of the MCU state that only ever changes through writes of
+	this module: the firmware version, reset event flags and VCOMs, the
+	interrupt mask, the volume calibration, the static part of the info
+	registers and the whole storage area, read in a handful of transactions.
+	The low level register wrappers keep it current as they write, and in
+	warm mode they answer reads of it without touching the bus. The rest of
+	0x00-0x7F is either volatile or has side effects when read (received IRQs,
+	the upload and FIFO ports) and is never part of it. Under g_I2CLock, like
+	the registers themselves.
+*/
+#define SNAPSHOT_REG_COUNT 0x80
+
+/* each run is read in one transaction, a write has to start at a snapshotted register to be seen */
+static const struct {
+	u8 regid;
+	u8 size;
+} s_SnapshotRuns[] = {
+	{ MCUREG_VERSION_HIGH,           MCUREG_VCOM_BOTTOM - MCUREG_VERSION_HIGH + 1 },
+	{ MCUREG_IRQ_MASK_0,             MCUREG_IRQ_MASK_3 - MCUREG_IRQ_MASK_0 + 1 },
+	{ MCUREG_VOLUME_CALIBRATION_MIN, MCUREG_VOLUME_CALIBRATION_MAX - MCUREG_VOLUME_CALIBRATION_MIN + 1 },
+};
+
+#define SNAPSHOT_RUN_COUNT (sizeof(s_SnapshotRuns) / sizeof(s_SnapshotRuns[0]))
+
+static struct {
+	bool warm;
+	u32 valid[SNAPSHOT_REG_COUNT / 32]; /* registers of regs[] that hold the MCU's value */
+	u8 regs[SNAPSHOT_REG_COUNT];
+	bool info_valid;
+	u8 info[SNAPSHOT_INFO_STATIC_SIZE];
+	bool storage_valid;
+	s16 storage_offset; /* MCUREG_STORAGE_AREA_OFFSET as last written, -1 once unknown */
+	u8 storage[sizeof(MCU_StorageArea)];
+} s_Snapshot;
+
+static inline bool isValid(u32 reg)
+{
+	return (s_Snapshot.valid[reg >> 5] >> (reg & 31)) & 1;
+}
+
+static inline void setValid(u32 reg, bool valid)
+{
+	if (valid) s_Snapshot.valid[reg >> 5] |= 1u << (reg & 31);
+	else       s_Snapshot.valid[reg >> 5] &= ~(1u << (reg & 31));
+}
+
+/* the run `regid` starts in, or -1 */
+static s32 findRun(u8 regid)
+{
+	for (u32 i = 0; i < SNAPSHOT_RUN_COUNT; i++)
+		if (regid >= s_SnapshotRuns[i].regid && regid - s_SnapshotRuns[i].regid < s_SnapshotRuns[i].size)
+			return i;
+	
+	return -1;
+}
+
+static inline void dropAll()
+{
+	for (u32 i = 0; i < SNAPSHOT_REG_COUNT / 32; i++)
+		s_Snapshot.valid[i] = 0;
+	
+	s_Snapshot.info_valid = false;
+	s_Snapshot.storage_valid = false;
+	s_Snapshot.storage_offset = -1;
+}
+
+static Result _mcuTakeRegisterSnapshot()
+{
+	Result res = 0;
+	bool warm = s_Snapshot.warm;
+	
+	/* the reads below have to reach the bus */
+	s_Snapshot.warm = false;
+	dropAll();
+	
+	for (u32 i = 0; i < SNAPSHOT_RUN_COUNT && R_SUCCEEDED(res); i++) {
+		u8 regid = s_SnapshotRuns[i].regid;
+		
+		res = mcuReadRegisterBuffer8(regid, &s_Snapshot.regs[regid], s_SnapshotRuns[i].size);
+		
+		for (u32 j = 0; j < s_SnapshotRuns[i].size && R_SUCCEEDED(res); j++)
+			setValid(regid + j, true);
+	}
+	
+	if (R_SUCCEEDED(res)) {
+		res = mcuReadRegisterBuffer8(MCUREG_INFO, s_Snapshot.info, SNAPSHOT_INFO_STATIC_SIZE);
+		s_Snapshot.info_valid = R_SUCCEEDED(res);
+	}
+	
+	if (R_SUCCEEDED(res)) {
+		res = mcuReadStorageArea(0, s_Snapshot.storage, sizeof(MCU_StorageArea), NOLOCK);
+		s_Snapshot.storage_valid = R_SUCCEEDED(res);
+	}
+	
+	s_Snapshot.warm = warm;
+	return res;
+}
+
+/* whatever failed to read stays cold and keeps going to the bus */
+Result mcuTakeRegisterSnapshot()
+{
+	Result res;
+	
+	I2C_LOCKED(
+		res = _mcuTakeRegisterSnapshot()
+	)
+	
+	return res;
+}
+
+/* for when the MCU itself changes underneath, like a firmware update */
+void mcuDropRegisterSnapshot()
+{
+	I2C_LOCKED(
+		dropAll()
+	)
+}
+
+/* a fresh snapshot is taken on the way into warm mode, so it doesn't start out with whatever was cold */
+Result mcuSetRegisterSnapshotWarm(bool warm)
+{
+	Result res = 0;
+	
+	I2C_LOCKED(
+		if (warm)
+			res = _mcuTakeRegisterSnapshot();
+		
+		s_Snapshot.warm = warm;
+	)
+	
+	return res;
+}
+
+bool mcuReadRegisterSnapshot(u8 regid, void *out, u32 size)
+{
+	if (!s_Snapshot.warm || !size)
+		return false;
+	
+	if (regid == MCUREG_INFO) {
+		if (!s_Snapshot.info_valid || size > SNAPSHOT_INFO_STATIC_SIZE)
+			return false;
+		
+		_memcpy(out, s_Snapshot.info, size);
+		return true;
+	}
+	
+	if (regid + size > SNAPSHOT_REG_COUNT)
+		return false;
+	
+	for (u32 i = 0; i < size; i++)
+		if (!isValid(regid + i))
+			return false;
+	
+	_memcpy(out, &s_Snapshot.regs[regid], size);
+	return true;
+}
+
+bool mcuReadStorageSnapshot(u8 offset, void *out, u32 size)
+{
+	if (!s_Snapshot.warm || !s_Snapshot.storage_valid || offset + size > sizeof(MCU_StorageArea))
+		return false;
+	
+	_memcpy(out, &s_Snapshot.storage[offset], size);
+	return true;
+}
+
+void mcuTrackRegisterWrite(u8 regid, const void *buf, u32 size, bool succeeded)
+{
+	const u8 *data = (const u8 *)buf;
+	
+	if (regid == MCUREG_STORAGE_AREA_OFFSET) {
+		s_Snapshot.storage_offset = succeeded && size == 1 ? data[0] : -1;
+		return;
+	}
+	
+	if (regid == MCUREG_STORAGE_AREA) {
+		u32 offset = s_Snapshot.storage_offset;
+		
+		/* the MCU moves its offset along, it's set again before every access anyway */
+		if (!succeeded || s_Snapshot.storage_offset < 0 || offset + size > sizeof(MCU_StorageArea))
+			s_Snapshot.storage_valid = false;
+		else
+			_memcpy(&s_Snapshot.storage[offset], data, size);
+		
+		s_Snapshot.storage_offset = -1;
+		return;
+	}
+	
+	s32 run = findRun(regid);
+	
+	if (run < 0)
+		return;
+	
+	/* what's past the end of the run lands in registers that aren't kept */
+	u32 end = s_SnapshotRuns[run].regid + s_SnapshotRuns[run].size;
+	
+	for (u32 i = 0; i < size && regid + i < end; i++) {
+		s_Snapshot.regs[regid + i] = data[i];
+		setValid(regid + i, succeeded);
+	}
+}
+
+void mcuTrackRegisterBits(u8 regid, u8 mask, u8 data, bool succeeded)
+{
+	if (findRun(regid) < 0)
+		return;
+	
+	s_Snapshot.regs[regid] = (s_Snapshot.regs[regid] & ~mask) | (data & mask);
+	
+	if (!succeeded)
+		setValid(regid, false);
+}
+
+void mcuTrackRegisterRead(u8 regid)
+{
+	if (regid == MCUREG_STORAGE_AREA)
+		s_Snapshot.storage_offset = -1;
+}
@@ -0,0 +1,116 @@
+#include <3ds/synchronization.h>
+#include <mcu/globals.h>
+#include <3ds/result.h>
+#include <mcu/status.h>
+#include <3ds/err.h>
+#include <3ds/svc.h>
+#include <mcu/mcu.h>
+#include <util.h>
+
+/*
+	Backing memory of the shared status page. Writers are the IRQ thread, the
+	worker thread and session threads, serialized by g_StatusPageLock among
+	themselves, readers in other processes only go by `sequence`.
+*/
+static union {
+	MCU_StatusPage page;
+	u8 raw[MCU_STATUS_PAGE_SIZE];
+} s_Status __attribute__((aligned(MCU_STATUS_PAGE_SIZE)));
+
+static Handle s_StatusBlock;
+
+static inline void beginUpdate()
+{
+	RecursiveLock_Lock(&g_StatusPageLock);
+	s_Status.page.sequence++;
+	__dmb();
+}
+
+static inline void endUpdate()
+{
+	s_Status.page.updates++;
+	s_Status.page.updated_tick = svcGetSystemTick();
+	__dmb();
+	s_Status.page.sequence++;
+	RecursiveLock_Unlock(&g_StatusPageLock);
+}
+
+/* fills in what nothing else publishes and creates the block, the rest comes in as it's read or written anyway */
+Result mcuInitStatusPage()
+{
+	u8 fw_high = 0, fw_low = 0;
+	u8 leds[5] = { 0 };
+	
+	I2C_LOCKED({
+		T(mcuReadFwVersion(&fw_high, &fw_low, NOLOCK));
+		T(mcuGetPowerLedState(&leds[0], NOLOCK));
+		T(mcuGetLedState(MCUREG_WLAN_LED_STATE, &leds[1], NOLOCK));
+		T(mcuGetLedState(MCUREG_CAMERA_LED_STATE, &leds[2], NOLOCK));
+		T(mcuGetLedState(MCUREG_3D_LED_STATE, &leds[3], NOLOCK));
+		T(mcuGetLedState(MCUREG_LED_BRIGHTNESS_STATE, &leds[4], NOLOCK));
+	})
+	
+	beginUpdate();
+	s_Status.page.version = MCU_STATUS_PAGE_VERSION;
+	s_Status.page.fw_version_high = fw_high;
+	s_Status.page.fw_version_low = fw_low;
+	s_Status.page.power_led_state = leds[0];
+	s_Status.page.wlan_led_state = leds[1];
+	s_Status.page.camera_led_state = leds[2];
+	s_Status.page.led_3d_state = leds[3];
+	s_Status.page.led_brightness = leds[4];
+	endUpdate();
+	
+	return svcCreateMemoryBlock(&s_StatusBlock, (u32)&s_Status, MCU_STATUS_PAGE_SIZE, MEMPERM_READWRITE, MEMPERM_READ);
+}
+
+void mcuExitStatusPage()
+{
+	T(svcCloseHandle(s_StatusBlock));
+}
+
+Handle mcuGetStatusPageBlock()
+{
+	return s_StatusBlock;
+}
+
+void mcuPublishPowerStatus(u8 power_status)
+{
+	beginUpdate();
+	s_Status.page.power_status = power_status;
+	endUpdate();
+}
+
+void mcuPublishBatterySample(const MCU_BatterySample *sample, u8 power_status)
+{
+	beginUpdate();
+	s_Status.page.power_status = power_status;
+	s_Status.page.battery_temperature = sample->temperature;
+	s_Status.page.battery_voltage = sample->voltage;
+	s_Status.page.battery_percentage = sample->percentage;
+	endUpdate();
+}
+
+void mcuPublishVolumeSlider(u8 raw, u8 level)
+{
+	beginUpdate();
+	s_Status.page.volume_slider = raw;
+	s_Status.page.volume_level = level;
+	endUpdate();
+}
+
+void mcuPublishLedState(u8 led_regid, u8 state)
+{
+	beginUpdate();
+	
+	switch (led_regid) {
+	case MCUREG_POWER_LED_STATE:      s_Status.page.power_led_state = state; break;
+	case MCUREG_WLAN_LED_STATE:       s_Status.page.wlan_led_state = state; break;
+	case MCUREG_CAMERA_LED_STATE:     s_Status.page.camera_led_state = state; break;
+	case MCUREG_3D_LED_STATE:         s_Status.page.led_3d_state = state; break;
+	case MCUREG_LED_BRIGHTNESS_STATE: s_Status.page.led_brightness = state; break;
+	default: break;
+	}
+	
+	endUpdate();
+}
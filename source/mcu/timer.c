@@ -0,0 +1,258 @@
+#include <3ds/synchronization.h>
+#include <mcu/globals.h>
+#include <3ds/result.h>
+#include <mcu/alarm.h>
+#include <mcu/timer.h>
+#include <3ds/err.h>
+#include <3ds/svc.h>
+#include <mcu/mcu.h>
+#include <memops.h>
+#include <util.h>
+
+/*
+	Millisecond wake timers. The fine-grained part is the worker thread waiting
+	on the nearest deadline in system ticks. The system tick stops while the
+	console sleeps though, so long timers also remember their deadline in RTC
+	seconds and put a coarse RTC alarm a minute ahead of it. When that alarm
+	fires, the tick deadlines are re-anchored on the RTC if it shows they fell
+	behind. Everything is under g_TimerLock.
+*/
+static struct {
+	struct {
+		void *owner;
+		u32 id;
+		s64 deadline;
+		u32 rtc_deadline; /* seconds since 2000, 0 for short timers */
+		u32 alarm_id;
+	} timers[TIMER_COUNT];
+	struct {
+		void *owner;
+		Handle event;
+	} owners[TIMER_OWNER_COUNT];
+	u32 next_id;
+	bool resync;
+	/* coarse alarms that fired since the last resync, these are written with g_I2CLock held */
+	u32 fired_alarm_ids[TIMER_COUNT];
+	u32 fired_alarm_count;
+	MCU_TimerStats stats;
+} s_Timers;
+
+static Handle ownerEvent(void *owner)
+{
+	for (u32 i = 0; i < TIMER_OWNER_COUNT; i++)
+		if (s_Timers.owners[i].owner == owner)
+			return s_Timers.owners[i].event;
+	
+	return 0;
+}
+
+static void freeTimer(u32 index)
+{
+	if (s_Timers.timers[index].alarm_id)
+		mcuCancelRtcAlarm(RTC_ALARM_TIMER_OWNER, s_Timers.timers[index].alarm_id);
+	
+	_memset32_aligned(&s_Timers.timers[index], 0, sizeof(s_Timers.timers[index]));
+}
+
+static Result _mcuStartTimer(void *owner, u32 ms, u32 *out_id, Handle *out_event)
+{
+	u32 index = 0, slot = TIMER_OWNER_COUNT;
+	
+	for (; index < TIMER_COUNT; index++)
+		if (!s_Timers.timers[index].owner)
+			break;
+	
+	for (u32 i = 0; i < TIMER_OWNER_COUNT; i++) {
+		if (s_Timers.owners[i].owner == owner) {
+			slot = i;
+			break;
+		}
+		
+		if (!s_Timers.owners[i].owner && slot == TIMER_OWNER_COUNT)
+			slot = i;
+	}
+	
+	if (index == TIMER_COUNT || slot == TIMER_OWNER_COUNT)
+		return MCU_OUT_OF_SUBSCRIPTIONS;
+	
+	if (!s_Timers.owners[slot].owner) {
+		Result res = svcCreateEvent(&s_Timers.owners[slot].event, RESET_ONESHOT);
+		if (R_FAILED(res)) return res;
+		
+		s_Timers.owners[slot].owner = owner;
+	}
+	
+	u32 rtc_deadline = 0, alarm_id = 0;
+	
+	if (ms >= TIMER_COARSE_MIN_MS) {
+		u32 seconds = 0;
+		
+		Result res = mcuGetRtcSeconds(&seconds, LOCK);
+		if (R_FAILED(res)) return res;
+		
+		rtc_deadline = seconds + ms / 1000;
+		
+		res = mcuAddInternalRtcAlarm(RTC_ALARM_TIMER_OWNER, rtc_deadline / 60 - 1, &alarm_id);
+		if (R_FAILED(res)) return res;
+	}
+	
+	if (!++s_Timers.next_id)
+		s_Timers.next_id = 1;
+	
+	s_Timers.timers[index].owner = owner;
+	s_Timers.timers[index].id = s_Timers.next_id;
+	s_Timers.timers[index].deadline = svcGetSystemTick() + MS_TO_TICKS(ms);
+	s_Timers.timers[index].rtc_deadline = rtc_deadline;
+	s_Timers.timers[index].alarm_id = alarm_id;
+	
+	*out_id = s_Timers.next_id;
+	*out_event = s_Timers.owners[slot].event;
+	return 0;
+}
+
+Result mcuStartTimer(void *owner, u32 ms, u32 *out_id, Handle *out_event)
+{
+	RecursiveLock_Lock(&g_TimerLock);
+	Result res = _mcuStartTimer(owner, ms, out_id, out_event);
+	RecursiveLock_Unlock(&g_TimerLock);
+	
+	/* have the worker thread pick up the new deadline */
+	if (R_SUCCEEDED(res))
+		T(svcSignalEvent(g_WorkerEvent));
+	
+	return res;
+}
+
+Result mcuCancelTimer(void *owner, u32 id)
+{
+	Result res = MCU_INVALID_TOKEN;
+	
+	RecursiveLock_Lock(&g_TimerLock);
+	
+	for (u32 i = 0; i < TIMER_COUNT; i++) {
+		if (id && s_Timers.timers[i].id == id && s_Timers.timers[i].owner == owner) {
+			freeTimer(i);
+			res = 0;
+			break;
+		}
+	}
+	
+	RecursiveLock_Unlock(&g_TimerLock);
+	
+	return res;
+}
+
+void mcuReleaseTimers(void *owner)
+{
+	RecursiveLock_Lock(&g_TimerLock);
+	
+	for (u32 i = 0; i < TIMER_COUNT; i++)
+		if (s_Timers.timers[i].owner == owner)
+			freeTimer(i);
+	
+	for (u32 i = 0; i < TIMER_OWNER_COUNT; i++) {
+		if (s_Timers.owners[i].owner == owner) {
+			T(svcCloseHandle(s_Timers.owners[i].event));
+			s_Timers.owners[i].owner = NULL;
+			s_Timers.owners[i].event = 0;
+		}
+	}
+	
+	RecursiveLock_Unlock(&g_TimerLock);
+}
+
+void mcuGetTimerStats(MCU_TimerStats *out_stats)
+{
+	RecursiveLock_Lock(&g_TimerLock);
+	_memcpy32_aligned(out_stats, &s_Timers.stats, sizeof(MCU_TimerStats));
+	RecursiveLock_Unlock(&g_TimerLock);
+}
+
+/* a coarse alarm fired, called with g_I2CLock held so only note it for the worker thread */
+void mcuResyncTimers(u32 alarm_id)
+{
+	if (s_Timers.fired_alarm_count < TIMER_COUNT)
+		s_Timers.fired_alarm_ids[s_Timers.fired_alarm_count++] = alarm_id;
+	
+	s_Timers.resync = true;
+	T(svcSignalEvent(g_WorkerEvent));
+}
+
+static void resyncTimers(s64 now)
+{
+	u32 seconds = 0;
+	u32 fired_ids[TIMER_COUNT];
+	u32 fired_count;
+	
+	I2C_LOCKED(
+		fired_count = s_Timers.fired_alarm_count;
+		_memcpy32_aligned(fired_ids, s_Timers.fired_alarm_ids, fired_count * sizeof(u32));
+		s_Timers.fired_alarm_count = 0;
+	)
+	
+	if (R_FAILED(mcuGetRtcSeconds(&seconds, LOCK)))
+		return;
+	
+	for (u32 i = 0; i < TIMER_COUNT; i++) {
+		if (!s_Timers.timers[i].owner || !s_Timers.timers[i].rtc_deadline)
+			continue;
+		
+		u32 remaining = s_Timers.timers[i].rtc_deadline > seconds ? s_Timers.timers[i].rtc_deadline - seconds : 0;
+		s64 deadline = now + MS_TO_TICKS(remaining * 1000);
+		
+		/* the RTC only has whole seconds, so it only wins if the tick deadline is clearly behind, i.e. the console slept */
+		if (deadline + MS_TO_TICKS(1000) < s_Timers.timers[i].deadline)
+			s_Timers.timers[i].deadline = deadline;
+		
+		/* only the timers whose own coarse alarm fired have it spent, the others still hold theirs */
+		for (u32 j = 0; j < fired_count; j++) {
+			if (fired_ids[j] == s_Timers.timers[i].alarm_id) {
+				s_Timers.timers[i].alarm_id = 0;
+				break;
+			}
+		}
+	}
+}
+
+/* fires what's due, returns the nearest deadline left, 0 if there is none */
+s64 mcuRunTimers(s64 now)
+{
+	s64 next = 0;
+	
+	RecursiveLock_Lock(&g_TimerLock);
+	
+	if (s_Timers.resync) {
+		s_Timers.resync = false;
+		resyncTimers(now);
+	}
+	
+	for (u32 i = 0; i < TIMER_COUNT; i++) {
+		if (!s_Timers.timers[i].owner)
+			continue;
+		
+		if (now < s_Timers.timers[i].deadline) {
+			if (!next || s_Timers.timers[i].deadline < next)
+				next = s_Timers.timers[i].deadline;
+			
+			continue;
+		}
+		
+		Handle event = ownerEvent(s_Timers.timers[i].owner);
+		
+		if (event)
+			T(svcSignalEvent(event));
+		
+		u32 late_us = TICKS_TO_US(now - s_Timers.timers[i].deadline);
+		
+		s_Timers.stats.fired++;
+		s_Timers.stats.last_late_us = late_us;
+		s_Timers.stats.max_late_us = MAX(s_Timers.stats.max_late_us, late_us);
+		s_Timers.stats.total_late_us += late_us;
+		
+		freeTimer(i);
+	}
+	
+	RecursiveLock_Unlock(&g_TimerLock);
+	
+	return next;
+}
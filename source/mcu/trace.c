@@ -0,0 +1,97 @@
+#include <3ds/synchronization.h>
+#include <mcu/globals.h>
+#include <mcu/trace.h>
+#include <memops.h>
+#include <util.h>
+
+/* flight recorder, only written by the IRQ thread while it holds g_ExclusiveIRQLock */
+static MCU_IrqTraceRecord s_IrqTrace[IRQ_TRACE_RECORD_COUNT];
+static u32 s_IrqTraceTotal;
+
+/* sort buffer for the summary, session thread stacks are too small for it, also under g_ExclusiveIRQLock */
+static u32 s_IrqTraceValues[IRQ_TRACE_RECORD_COUNT];
+
+void mcuTraceIrq(s64 wake_tick, s64 locked_tick, s64 read_tick, s64 dispatch_tick, u32 irqs)
+{
+	MCU_IrqTraceRecord *record = &s_IrqTrace[s_IrqTraceTotal & (IRQ_TRACE_RECORD_COUNT - 1)];
+	
+	record->wake_tick = wake_tick;
+	record->lock_wait = (u32)(locked_tick - wake_tick);
+	record->read_done = (u32)(read_tick - wake_tick);
+	record->dispatch_done = (u32)(dispatch_tick - wake_tick);
+	record->irqs = irqs;
+	
+	s_IrqTraceTotal++;
+}
+
+static inline u32 irqTraceRecordCount()
+{
+	return MIN(s_IrqTraceTotal, IRQ_TRACE_RECORD_COUNT);
+}
+
+u32 mcuDumpIrqTrace(MCU_IrqTraceRecord *out_records, u32 max_records, u32 *out_total)
+{
+	RecursiveLock_Lock(&g_ExclusiveIRQLock);
+	
+	u32 count = MIN(irqTraceRecordCount(), max_records);
+	u32 first = s_IrqTraceTotal - count;
+	
+	/* oldest first */
+	for (u32 i = 0; i < count; i++)
+		_memcpy(&out_records[i], &s_IrqTrace[(first + i) & (IRQ_TRACE_RECORD_COUNT - 1)], sizeof(MCU_IrqTraceRecord));
+	
+	*out_total = s_IrqTraceTotal;
+	
+	RecursiveLock_Unlock(&g_ExclusiveIRQLock);
+	
+	return count;
+}
+
+static void computePercentiles(MCU_IrqTracePercentiles *out, u32 *values, u32 count)
+{
+	_memset32_aligned(out, 0, sizeof(MCU_IrqTracePercentiles));
+	
+	if (!count)
+		return;
+	
+	/* at most IRQ_TRACE_RECORD_COUNT entries, insertion sort is plenty */
+	for (u32 i = 1; i < count; i++) {
+		u32 value = values[i];
+		u32 j = i;
+		
+		for (; j > 0 && values[j - 1] > value; j--)
+			values[j] = values[j - 1];
+		
+		values[j] = value;
+	}
+	
+	out->p50_us = TICKS_TO_US(values[(count * 50) / 100]);
+	out->p90_us = TICKS_TO_US(values[(count * 90) / 100]);
+	out->p99_us = TICKS_TO_US(values[(count * 99) / 100]);
+	out->max_us = TICKS_TO_US(values[count - 1]);
+}
+
+void mcuGetIrqTraceSummary(MCU_IrqTraceSummary *out_summary)
+{
+	u32 *values = s_IrqTraceValues;
+	u32 count;
+	
+	RecursiveLock_Lock(&g_ExclusiveIRQLock);
+	
+	count = irqTraceRecordCount();
+	out_summary->total_records = s_IrqTraceTotal;
+	out_summary->samples = count;
+	
+	/* one column at a time through the same buffer */
+	for (u32 i = 0; i < count; i++)
+		values[i] = s_IrqTrace[i].read_done;
+	
+	computePercentiles(&out_summary->read, values, count);
+	
+	for (u32 i = 0; i < count; i++)
+		values[i] = s_IrqTrace[i].dispatch_done;
+	
+	computePercentiles(&out_summary->dispatch, values, count);
+	
+	RecursiveLock_Unlock(&g_ExclusiveIRQLock);
+}
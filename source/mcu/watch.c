@@ -0,0 +1,322 @@
+#include <3ds/synchronization.h>
+#include <mcu/globals.h>
+#include <3ds/result.h>
+#include <mcu/watch.h>
+#include <3ds/err.h>
+#include <3ds/svc.h>
+#include <mcu/mcu.h>
+#include <memops.h>
+#include <util.h>
+
+/*
+	Register watches, run by the worker thread off one min-heap of deadlines.
+	Deadlines are aligned to multiples of the interval, so watches with the
+	same interval come due together and a register watched by several clients
+	is still read once. Everything due at the same time is read in runs of
+	adjacent single byte registers, one transaction per run, so the bus traffic follows
+	the number of distinct registers and not the number of clients. Under
+	g_WatchLock.
+*/
+typedef struct RegisterWatch {
+	void *owner;
+	u32 id;
+	Handle event;
+	s64 deadline;
+	u32 interval_ms;
+	u8 regid;
+	u8 mask;
+	u8 value; /* last masked value */
+	u8 reserved;
+} RegisterWatch;
+
+static struct {
+	RegisterWatch watches[REGISTER_WATCH_COUNT];
+	u8 heap[REGISTER_WATCH_COUNT]; /* watch indices */
+	u8 count;
+	u32 next_id;
+	u32 due[256 / 32];             /* registers to read this round */
+	u32 read[256 / 32];            /* ...and the ones that were read fine */
+	u8 values[256];
+} s_Watch;
+
+/*
+	What a watch may poll: plain single byte registers with no side effect on
+	reading. Multi-byte ones like MCUREG_POWER_LED_STATE (5 bytes) or
+	MCUREG_NOTIFICATION_LED_STATE (100 bytes) would shift everything after
+	them in a merged read, reading the received IRQs acknowledges them, and
+	the upload, storage and accelerometer I/O ports are streams. Runs are only
+	merged within one of these ranges.
+*/
+static const struct {
+	u8 first;
+	u8 last;
+} s_WatchableRegs[] = {
+	{ MCUREG_VERSION_HIGH,                 MCUREG_VCOM_BOTTOM },
+	{ MCUREG_3D_SLIDER_POSITION,           MCUREG_BATTERY_VOLTAGE },
+	{ MCUREG_POWER_STATUS,                 MCUREG_POWER_STATUS },
+	{ MCUREG_IRQ_MASK_0,                   MCUREG_IRQ_MASK_3 },
+	{ MCUREG_FORCE_SHUTDOWN_DELAY,         MCUREG_FORCE_SHUTDOWN_DELAY },
+	{ MCUREG_LED_BRIGHTNESS_STATE,         MCUREG_LED_BRIGHTNESS_STATE },
+	{ MCUREG_WLAN_LED_STATE,               MCUREG_3D_LED_STATE },
+	{ MCUREG_NOTIFICATION_LED_CYCLE_STATE, MCUREG_NOTIFICATION_LED_CYCLE_STATE },
+	{ MCUREG_RTC_TIME_SECOND,              MCUREG_TICK_COUNTER_MSB },
+	{ MCUREG_OMETER_MODE,                  MCUREG_OMETER_MODE },
+	{ MCUREG_ACCELEROMETER_OUTPUT_X_LSB,   MCUREG_PEDOMETER_CNT },
+	{ MCUREG_PEDOMETER_WRAP_MINUTE,        MCUREG_PEDOMETER_WRAP_SECOND },
+	{ MCUREG_VOLUME_CALIBRATION_MIN,       MCUREG_VOLUME_CALIBRATION_MAX },
+};
+
+#define WATCHABLE_RANGE_COUNT (sizeof(s_WatchableRegs) / sizeof(s_WatchableRegs[0]))
+
+/* the allowlist range holding the register, WATCHABLE_RANGE_COUNT if there is none */
+static u32 watchableRange(u32 regid)
+{
+	for (u32 i = 0; i < WATCHABLE_RANGE_COUNT; i++)
+		if (regid >= s_WatchableRegs[i].first && regid <= s_WatchableRegs[i].last)
+			return i;
+	
+	return WATCHABLE_RANGE_COUNT;
+}
+
+#define REGBIT_SET(bits, regid) ((bits)[(regid) >> 5] |= 1u << ((regid) & 31))
+#define REGBIT_GET(bits, regid) (((bits)[(regid) >> 5] >> ((regid) & 31)) & 1)
+
+static inline s64 heapKey(u32 position)
+{
+	return s_Watch.watches[s_Watch.heap[position]].deadline;
+}
+
+static inline void heapSwap(u32 a, u32 b)
+{
+	u8 tmp = s_Watch.heap[a];
+	s_Watch.heap[a] = s_Watch.heap[b];
+	s_Watch.heap[b] = tmp;
+}
+
+static void heapSiftUp(u32 position)
+{
+	while (position) {
+		u32 parent = (position - 1) >> 1;
+		
+		if (heapKey(parent) <= heapKey(position))
+			break;
+		
+		heapSwap(parent, position);
+		position = parent;
+	}
+}
+
+static void heapSiftDown(u32 position)
+{
+	while (true) {
+		u32 smallest = position;
+		u32 left = position * 2 + 1;
+		u32 right = left + 1;
+		
+		if (left < s_Watch.count && heapKey(left) < heapKey(smallest))
+			smallest = left;
+		
+		if (right < s_Watch.count && heapKey(right) < heapKey(smallest))
+			smallest = right;
+		
+		if (smallest == position)
+			break;
+		
+		heapSwap(smallest, position);
+		position = smallest;
+	}
+}
+
+static inline void heapPush(u8 index)
+{
+	s_Watch.heap[s_Watch.count] = index;
+	heapSiftUp(s_Watch.count++);
+}
+
+/* takes the watch at a heap position out of the heap, the watch itself stays */
+static u8 heapTake(u32 position)
+{
+	u8 index = s_Watch.heap[position];
+	
+	if (position != --s_Watch.count) {
+		s_Watch.heap[position] = s_Watch.heap[s_Watch.count];
+		heapSiftDown(position);
+		heapSiftUp(position);
+	}
+	
+	return index;
+}
+
+/* the next multiple of the interval, the same for every watch with that interval */
+static inline s64 alignedDeadline(s64 now, u32 interval_ms)
+{
+	u64 interval = MS_TO_TICKS(interval_ms);
+	
+	return (udiv64(now, interval) + 1) * interval;
+}
+
+static Result _mcuAddRegisterWatch(void *owner, u8 regid, u8 mask, u32 interval_ms, u32 *out_id, u8 *out_value, Handle *out_event)
+{
+	u32 index = 0;
+	u8 value = 0;
+	
+	for (; index < REGISTER_WATCH_COUNT; index++)
+		if (!s_Watch.watches[index].owner)
+			break;
+	
+	if (index == REGISTER_WATCH_COUNT)
+		return MCU_OUT_OF_SUBSCRIPTIONS;
+	
+	/* the starting value, so the first event really means a change */
+	Result res = mcuReadRegisterBuffer8_l(regid, &value, sizeof(u8));
+	if (R_FAILED(res)) return res;
+	
+	RegisterWatch *watch = &s_Watch.watches[index];
+	
+	res = svcCreateEvent(&watch->event, RESET_ONESHOT);
+	if (R_FAILED(res)) return res;
+	
+	if (!++s_Watch.next_id)
+		s_Watch.next_id = 1;
+	
+	watch->owner = owner;
+	watch->id = s_Watch.next_id;
+	watch->deadline = alignedDeadline(svcGetSystemTick(), interval_ms);
+	watch->interval_ms = interval_ms;
+	watch->regid = regid;
+	watch->mask = mask;
+	watch->value = value & mask;
+	
+	heapPush(index);
+	
+	*out_id = watch->id;
+	*out_value = watch->value;
+	*out_event = watch->event;
+	return 0;
+}
+
+Result mcuAddRegisterWatch(void *owner, u8 regid, u8 mask, u32 interval_ms, u32 *out_id, u8 *out_value, Handle *out_event)
+{
+	if (!mask || interval_ms < REGISTER_WATCH_MIN_INTERVAL_MS || watchableRange(regid) == WATCHABLE_RANGE_COUNT)
+		return MCU_OUT_OF_RANGE;
+	
+	RecursiveLock_Lock(&g_WatchLock);
+	Result res = _mcuAddRegisterWatch(owner, regid, mask, interval_ms, out_id, out_value, out_event);
+	RecursiveLock_Unlock(&g_WatchLock);
+	
+	/* have the worker thread pick up the new deadline */
+	if (R_SUCCEEDED(res))
+		T(svcSignalEvent(g_WorkerEvent));
+	
+	return res;
+}
+
+static void removeWatch(u32 position)
+{
+	RegisterWatch *watch = &s_Watch.watches[heapTake(position)];
+	
+	T(svcCloseHandle(watch->event));
+	_memset32_aligned(watch, 0, sizeof(RegisterWatch));
+}
+
+Result mcuRemoveRegisterWatch(void *owner, u32 id)
+{
+	Result res = MCU_INVALID_TOKEN;
+	
+	RecursiveLock_Lock(&g_WatchLock);
+	
+	for (u32 i = 0; i < s_Watch.count; i++) {
+		RegisterWatch *watch = &s_Watch.watches[s_Watch.heap[i]];
+		
+		if (id && watch->id == id && watch->owner == owner) {
+			removeWatch(i);
+			res = 0;
+			break;
+		}
+	}
+	
+	RecursiveLock_Unlock(&g_WatchLock);
+	
+	return res;
+}
+
+void mcuReleaseRegisterWatches(void *owner)
+{
+	RecursiveLock_Lock(&g_WatchLock);
+	
+	for (u32 i = 0; i < s_Watch.count;) {
+		if (s_Watch.watches[s_Watch.heap[i]].owner == owner)
+			removeWatch(i); /* something else moved into this position */
+		else
+			i++;
+	}
+	
+	RecursiveLock_Unlock(&g_WatchLock);
+}
+
+/* reads every register marked due, adjacent ones in the same allowlist range together */
+static void readDueRegisters()
+{
+	_memset32_aligned(s_Watch.read, 0, sizeof(s_Watch.read));
+	
+	for (u32 regid = 0; regid < 256;) {
+		if (!REGBIT_GET(s_Watch.due, regid)) {
+			regid++;
+			continue;
+		}
+		
+		/* every due register passed watchableRange when its watch was added */
+		u32 last = s_WatchableRegs[watchableRange(regid)].last;
+		u32 size = 1;
+		
+		while (regid + size <= last && size < REGISTER_WATCH_MERGE_MAX && REGBIT_GET(s_Watch.due, regid + size))
+			size++;
+		
+		/* a failed read leaves those watches with their old value until the next round */
+		if (R_SUCCEEDED(mcuReadRegisterBuffer8_l(regid, &s_Watch.values[regid], size)))
+			for (u32 i = 0; i < size; i++)
+				REGBIT_SET(s_Watch.read, regid + i);
+		
+		regid += size;
+	}
+}
+
+/* polls what's due, returns the nearest deadline left, 0 if there is none */
+s64 mcuRunRegisterWatches(s64 now)
+{
+	u8 due[REGISTER_WATCH_COUNT];
+	u32 due_count = 0;
+	s64 next = 0;
+	
+	RecursiveLock_Lock(&g_WatchLock);
+	
+	_memset32_aligned(s_Watch.due, 0, sizeof(s_Watch.due));
+	
+	while (s_Watch.count && heapKey(0) <= now) {
+		due[due_count] = heapTake(0);
+		REGBIT_SET(s_Watch.due, s_Watch.watches[due[due_count]].regid);
+		due_count++;
+	}
+	
+	if (due_count)
+		readDueRegisters();
+	
+	for (u32 i = 0; i < due_count; i++) {
+		RegisterWatch *watch = &s_Watch.watches[due[i]];
+		
+		if (REGBIT_GET(s_Watch.read, watch->regid) && (s_Watch.values[watch->regid] & watch->mask) != watch->value) {
+			watch->value = s_Watch.values[watch->regid] & watch->mask;
+			T(svcSignalEvent(watch->event));
+		}
+		
+		watch->deadline = alignedDeadline(now, watch->interval_ms);
+		heapPush(due[i]);
+	}
+	
+	if (s_Watch.count)
+		next = heapKey(0);
+	
+	RecursiveLock_Unlock(&g_WatchLock);
+	
+	return next;
+}
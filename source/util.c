@@ -6,4 +6,83 @@
 void *memset(void *s, int c, size_t n) {
 	_memset(s, c, n);
 	return s;
-}
\ No newline at end of file
+}
+
+u32 udiv32(u32 n, u32 d)
+{
+	u32 q = 0;
+	
+	if (!d)
+		return U32_MAX;
+	
+	/* plain shift-subtract long division */
+	for (s32 shift = 31; shift >= 0; shift--) {
+		if ((n >> shift) >= d) {
+			n -= d << shift;
+			q |= 1u << shift;
+		}
+	}
+	
+	return q;
+}
+
+u64 udiv64(u64 n, u64 d)
+{
+	u64 q = 0;
+	
+	if (!d)
+		return U64_MAX;
+	
+	for (s32 shift = 63; shift >= 0; shift--) {
+		if ((n >> shift) >= d) {
+			n -= d << shift;
+			q |= 1ull << shift;
+		}
+	}
+	
+	return q;
+}
+
+/* truncates toward zero, like C division */
+s64 sdiv64(s64 n, s64 d)
+{
+	u64 q = udiv64(n < 0 ? -(u64)n : (u64)n, d < 0 ? -(u64)d : (u64)d);
+	
+	return (n < 0) != (d < 0) ? -(s64)q : (s64)q;
+}
+
+/* days from 2000-01-01 to the given date (year since 2000), out of range months and days clamp to the first */
+static const u16 days_before_month[12] = { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 };
+
+u32 daysSince2000(u32 year, u32 month, u32 day)
+{
+	if (month < 1 || month > 12)
+		month = 1;
+	
+	u32 days = year * 365 + (year + 3) / 4 + days_before_month[month - 1] + (day ? day - 1 : 0);
+	
+	if ((year & 3) == 0 && month > 2)
+		days++;
+	
+	return days;
+}
+
+/* inverse of daysSince2000 */
+void dateFromDaysSince2000(u32 days, u8 *out_year, u8 *out_month, u8 *out_day)
+{
+	u32 year = 0;
+	
+	while (days >= ((year & 3) ? 365u : 366u))
+		days -= (year++ & 3) ? 365 : 366;
+	
+	u32 month = 12;
+	
+	while (month > 1 && days < days_before_month[month - 1] + (u32)((year & 3) == 0 && month > 2))
+		month--;
+	
+	days -= days_before_month[month - 1] + (u32)((year & 3) == 0 && month > 2);
+	
+	*out_year = (u8)year;
+	*out_month = (u8)month;
+	*out_day = (u8)(days + 1);
+}
@@ -0,0 +1,227 @@
+/*
+	Host test for the RTC alarm heap in source/mcu/alarm.c. The module is
+	included directly so the heap can be checked from the inside, and the
+	handful of MCU/kernel calls it makes are stubbed out below. Build and run
+	with `make -C tests`.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../source/mcu/alarm.c"
+
+RecursiveLock g_I2CLock;
+RecursiveLock g_ExclusiveIRQLock;
+
+static u32 s_NowMinute;
+static u32 s_ProgrammedKey;
+static u32 s_Signals;
+static u32 s_TimerResyncs;
+static u32 s_LastResyncId;
+static u32 s_LegacyDeliveries;
+static bool s_LeaseHeld;
+static u32 s_Failures;
+
+#define CHECK(cond) do { if (!(cond)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); s_Failures++; } } while (0)
+
+void RecursiveLock_Lock(RecursiveLock *lock) { (void)lock; }
+void RecursiveLock_Unlock(RecursiveLock *lock) { (void)lock; }
+
+Result svcCreateEvent(Handle *event, ResetType reset_type) { (void)reset_type; *event = 0x1234; return 0; }
+Result svcSignalEvent(Handle handle) { (void)handle; s_Signals++; return 0; }
+Result svcCloseHandle(Handle handle) { (void)handle; return 0; }
+s64 svcGetSystemTick(void) { return 0; }
+
+void ERRF_ThrowResultNoRet(Result failure)
+{
+	printf("thrown 0x%08lX\n", (unsigned long)failure);
+	exit(1);
+}
+
+Result mcuGetRtcSeconds(u32 *out_seconds, bool lock)
+{
+	(void)lock;
+	*out_seconds = s_NowMinute * 60;
+	return 0;
+}
+
+Result mcuSetRtcAlarm(MCU_RtcAlarm *alarm, bool lock)
+{
+	(void)lock;
+	s_ProgrammedKey = (alarm->minute | alarm->hour | alarm->day | alarm->month | alarm->year) ? alarmKey(alarm) : 0;
+	return 0;
+}
+
+void mcuResyncTimers(u32 alarm_id) { s_LastResyncId = alarm_id; s_TimerResyncs++; }
+
+bool mcuQueueExclusiveIrqs(u32 received_irqs, s64 tick)
+{
+	(void)received_irqs;
+	(void)tick;
+	return s_LeaseHeld;
+}
+
+/* what mcu.c does with MCUINT_RTC_ALARM */
+void mcuHandleInterruptEvents(u32 received_irqs)
+{
+	if ((received_irqs & MCUINT_RTC_ALARM) && mcuFireRtcAlarms())
+		s_LegacyDeliveries++;
+}
+
+static void reset()
+{
+	_memset(&s_Alarms, 0, sizeof(s_Alarms));
+	s_ProgrammedKey = s_Signals = s_TimerResyncs = s_LegacyDeliveries = 0;
+	s_LeaseHeld = false;
+	s_NowMinute = 0;
+}
+
+static bool heapValid()
+{
+	for (u32 i = 1; i < s_Alarms.count; i++)
+		if (heapKey((i - 1) >> 1) > heapKey(i))
+			return false;
+
+	return true;
+}
+
+static MCU_RtcAlarm alarmAt(u32 key)
+{
+	MCU_RtcAlarm alarm;
+	u32 days = key / (24 * 60);
+
+	dateFromDaysSince2000(days, &alarm.year, &alarm.month, &alarm.day);
+	alarm.hour = (u8)((key % (24 * 60)) / 60);
+	alarm.minute = (u8)(key % 60);
+	return alarm;
+}
+
+static void testHeapOrder()
+{
+	reset();
+	s_NowMinute = 1000;
+
+	u32 ids[RTC_ALARM_COUNT];
+
+	for (u32 i = 0; i < RTC_ALARM_COUNT; i++) {
+		CHECK(R_SUCCEEDED(mcuAddInternalRtcAlarm((void *)0x10, 2000 + (i * 7919) % 97, &ids[i])));
+		CHECK(heapValid());
+		CHECK(s_ProgrammedKey == heapKey(0));
+	}
+
+	u32 id;
+	CHECK(mcuAddInternalRtcAlarm((void *)0x10, 3000, &id) == MCU_OUT_OF_SUBSCRIPTIONS);
+
+	for (u32 i = 0; i < RTC_ALARM_COUNT; i += 3) {
+		CHECK(R_SUCCEEDED(mcuCancelRtcAlarm((void *)0x10, ids[i])));
+		CHECK(heapValid());
+		CHECK(s_ProgrammedKey == heapKey(0));
+	}
+
+	CHECK(mcuCancelRtcAlarm((void *)0x10, ids[0]) == MCU_INVALID_TOKEN);
+}
+
+static void testRelease()
+{
+	/* every owner layout of a full heap, the release has to find all of its entries */
+	for (u32 seed = 1; seed < 2000; seed++) {
+		reset();
+		s_NowMinute = 1000;
+
+		u32 rng = seed, id;
+
+		for (u32 i = 0; i < RTC_ALARM_COUNT; i++) {
+			rng = rng * 1103515245 + 12345;
+			void *owner = (rng >> 16) & 1 ? (void *)0x10 : (void *)0x20;
+			mcuAddInternalRtcAlarm(owner, 2000 + ((rng >> 8) & 0xFF), &id);
+		}
+
+		mcuReleaseRtcAlarms((void *)0x10);
+
+		for (u32 i = 0; i < s_Alarms.count; i++)
+			CHECK(s_Alarms.entries[s_Alarms.heap[i]].owner == (void *)0x20);
+
+		CHECK(heapValid());
+		CHECK(s_ProgrammedKey == (s_Alarms.count ? heapKey(0) : 0));
+	}
+}
+
+static void testRearm()
+{
+	reset();
+	s_NowMinute = 5000;
+
+	u32 id;
+	Handle event;
+	MCU_RtcAlarm past = alarmAt(4990);
+	MCU_RtcAlarm future = alarmAt(5100);
+
+	/* a past client alarm signals right away and isn't programmed */
+	CHECK(R_SUCCEEDED(mcuAddRtcAlarm((void *)0x10, &past, &id, &event)));
+	CHECK(s_Signals == 1);
+	CHECK(s_Alarms.count == 0);
+	CHECK(s_ProgrammedKey == 0);
+
+	CHECK(R_SUCCEEDED(mcuAddRtcAlarm((void *)0x10, &future, &id, &event)));
+	CHECK(s_ProgrammedKey == 5100);
+
+	/* the IRQ pops what's due, the timer owner resyncs instead of signalling */
+	CHECK(R_SUCCEEDED(mcuAddInternalRtcAlarm(RTC_ALARM_TIMER_OWNER, 5050, &id)));
+	CHECK(s_ProgrammedKey == 5050);
+	s_NowMinute = 5050;
+	CHECK(!mcuFireRtcAlarms());
+	CHECK(s_TimerResyncs == 1);
+	CHECK(s_LastResyncId == id);
+	CHECK(s_ProgrammedKey == 5100);
+
+	/* a legacy alarm written in the past is dropped, the MCU would never fire it */
+	MCU_RtcAlarm legacy = alarmAt(4000);
+	CHECK(R_SUCCEEDED(mcuSetLegacyRtcAlarm(&legacy)));
+	CHECK(s_LegacyDeliveries == 0);
+	CHECK(s_Alarms.legacy_id == 0);
+
+	/* so is every half-written value on the way to a future one, a field at a time */
+	MCU_RtcAlarm disabled = { 0, 0, 0, 0, 0 };
+	CHECK(R_SUCCEEDED(mcuSetLegacyRtcAlarm(&disabled)));
+	legacy = alarmAt(5200);
+
+	for (u32 i = 0; i < sizeof(MCU_RtcAlarm); i++)
+		CHECK(R_SUCCEEDED(mcuSetLegacyRtcAlarmField(MCUREG_RTC_ALARM_MINUTE + i, ((u8 *)&legacy)[i])));
+
+	CHECK(s_LegacyDeliveries == 0);
+	CHECK(s_Alarms.legacy_id != 0);
+	CHECK(!mcuFireRtcAlarms());
+
+	/* one that was accepted and then missed, popped on a later re-arm, is delivered once */
+	legacy = alarmAt(5060);
+	CHECK(R_SUCCEEDED(mcuSetLegacyRtcAlarm(&legacy)));
+	CHECK(s_ProgrammedKey == 5060);
+	s_NowMinute = 5070;
+	CHECK(R_SUCCEEDED(mcuAddInternalRtcAlarm((void *)0x20, 6000, &id)));
+	CHECK(s_LegacyDeliveries == 1);
+	CHECK(!mcuFireRtcAlarms());
+
+	/* while an exclusive IRQ lease is held it stays pending until the replay */
+	legacy = alarmAt(5080);
+	CHECK(R_SUCCEEDED(mcuSetLegacyRtcAlarm(&legacy)));
+	s_NowMinute = 5090;
+	s_LeaseHeld = true;
+	CHECK(R_SUCCEEDED(mcuAddInternalRtcAlarm((void *)0x20, 6010, &id)));
+	CHECK(s_LegacyDeliveries == 1);
+	mcuHandleInterruptEvents(MCUINT_RTC_ALARM);
+	CHECK(s_LegacyDeliveries == 2);
+}
+
+int main()
+{
+	testHeapOrder();
+	testRelease();
+	testRearm();
+
+	if (s_Failures) {
+		printf("%lu failure(s)\n", (unsigned long)s_Failures);
+		return 1;
+	}
+
+	printf("ok\n");
+	return 0;
+}
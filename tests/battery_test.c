@@ -0,0 +1,256 @@
+/*
+	Host test and benchmark for the battery run time estimator in
+	source/mcu/battery.c. Register traces of a discharge followed by a charge,
+	one read a minute as the sampler backs off to, go through mcuSampleBattery
+	and the estimate is checked against the rate the trace was taken at. The
+	discharge includes a fuel gauge recalibration, a 1.5% drop while the
+	voltage recovers. Build and run with `make -C tests`.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../source/mcu/battery.c"
+
+RecursiveLock g_I2CLock;
+RecursiveLock g_BatteryLock;
+Handle g_BatteryEvent;
+Handle g_WorkerEvent;
+
+typedef struct BatteryTraceRow {
+	u32 seconds;
+	u8 temperature;
+	u8 percentage;
+	u8 fraction;
+	u8 voltage;
+	u8 power_status;
+} BatteryTraceRow;
+
+/* about 0.42% a minute with the backlights on */
+static const BatteryTraceRow s_DischargeTrace[] = {
+	{ 600, 31, 78, 0x00, 201, 0xE2 },
+	{ 661, 31, 77, 0x86, 200, 0xE2 },
+	{ 718, 31, 77, 0x16, 200, 0xE2 },
+	{ 778, 31, 76, 0xA1, 200, 0xE2 },
+	{ 838, 31, 76, 0x39, 200, 0xE2 },
+	{ 899, 31, 75, 0xC1, 200, 0xE2 },
+	{ 961, 31, 75, 0x64, 200, 0xE2 },
+	{ 1019, 31, 74, 0xFB, 200, 0xE2 },
+	{ 1081, 31, 74, 0x9C, 200, 0xE2 },
+	{ 1142, 31, 74, 0x3E, 199, 0xE2 },
+	{ 1199, 31, 73, 0xDE, 199, 0xE2 },
+	{ 1262, 31, 73, 0x6E, 199, 0xE2 },
+	{ 1322, 31, 72, 0xF5, 199, 0xE2 },
+	{ 1378, 31, 72, 0x87, 199, 0xE2 },
+	{ 1438, 31, 72, 0x0D, 199, 0xE2 },
+	{ 1499, 32, 71, 0xA0, 199, 0xE2 },
+	{ 1559, 32, 71, 0x3B, 199, 0xE2 },
+	{ 1622, 32, 70, 0xCE, 198, 0xE2 },
+	{ 1679, 32, 70, 0x68, 198, 0xE2 },
+	{ 1742, 32, 70, 0x09, 198, 0xE2 },
+	{ 1800, 32, 69, 0x99, 198, 0xE2 },
+	{ 1858, 32, 69, 0x3A, 198, 0xE2 },
+	{ 1922, 32, 67, 0x4C, 201, 0xE2 },
+	{ 1982, 32, 66, 0xEA, 201, 0xE2 },
+	{ 2040, 32, 66, 0x81, 201, 0xE2 },
+	{ 2101, 32, 66, 0x16, 200, 0xE2 },
+	{ 2159, 32, 65, 0xAF, 200, 0xE2 },
+	{ 2219, 32, 65, 0x3A, 200, 0xE2 },
+	{ 2280, 32, 64, 0xDC, 200, 0xE2 },
+	{ 2340, 32, 64, 0x6F, 200, 0xE2 },
+	{ 2400, 33, 63, 0xFD, 200, 0xE2 },
+	{ 2458, 33, 63, 0x8E, 200, 0xE2 },
+	{ 2521, 33, 63, 0x2E, 200, 0xE2 },
+	{ 2580, 33, 62, 0xCD, 200, 0xE2 },
+	{ 2641, 33, 62, 0x6C, 199, 0xE2 },
+	{ 2698, 33, 62, 0x03, 199, 0xE2 },
+	{ 2762, 33, 61, 0x8F, 199, 0xE2 },
+	{ 2820, 33, 61, 0x1B, 199, 0xE2 },
+	{ 2880, 33, 60, 0xB4, 199, 0xE2 },
+	{ 2942, 33, 60, 0x46, 199, 0xE2 },
+	{ 2998, 33, 59, 0xD1, 199, 0xE2 },
+	{ 3060, 33, 59, 0x5B, 199, 0xE2 },
+	{ 3118, 33, 58, 0xF1, 198, 0xE2 },
+	{ 3180, 33, 58, 0x93, 198, 0xE2 },
+	{ 3241, 33, 58, 0x22, 198, 0xE2 },
+};
+
+/* about 0.8% a minute on the adapter */
+static const BatteryTraceRow s_ChargeTrace[] = {
+	{ 3301, 34, 57, 0xBE, 198, 0xFA },
+	{ 3360, 34, 58, 0x9E, 198, 0xFA },
+	{ 3421, 34, 59, 0x53, 198, 0xFA },
+	{ 3482, 34, 60, 0x18, 199, 0xFA },
+	{ 3538, 34, 60, 0xD1, 199, 0xFA },
+	{ 3600, 34, 61, 0x90, 199, 0xFA },
+	{ 3659, 34, 62, 0x49, 199, 0xFA },
+	{ 3721, 34, 63, 0x11, 199, 0xFA },
+	{ 3781, 34, 63, 0xC8, 200, 0xFA },
+	{ 3840, 34, 64, 0x90, 200, 0xFA },
+	{ 3901, 34, 65, 0x70, 200, 0xFA },
+	{ 3960, 34, 66, 0x50, 200, 0xFA },
+	{ 4020, 34, 67, 0x27, 200, 0xFA },
+	{ 4081, 34, 67, 0xFD, 201, 0xFA },
+	{ 4139, 34, 68, 0xE2, 201, 0xFA },
+	{ 4199, 34, 69, 0x99, 201, 0xFA },
+	{ 4259, 34, 70, 0x58, 201, 0xFA },
+	{ 4322, 34, 71, 0x0C, 201, 0xFA },
+	{ 4380, 34, 71, 0xC8, 202, 0xFA },
+	{ 4441, 34, 72, 0x7C, 202, 0xFA },
+	{ 4502, 35, 73, 0x4A, 202, 0xFA },
+	{ 4559, 35, 74, 0x1B, 202, 0xFA },
+	{ 4622, 35, 74, 0xF1, 202, 0xFA },
+	{ 4678, 35, 75, 0xD5, 203, 0xFA },
+	{ 4742, 35, 76, 0xA0, 203, 0xFA },
+	{ 4801, 35, 77, 0x67, 203, 0xFA },
+	{ 4861, 35, 78, 0x2E, 203, 0xFA },
+	{ 4918, 35, 79, 0x02, 203, 0xFA },
+	{ 4979, 35, 79, 0xBF, 204, 0xFA },
+	{ 5038, 35, 80, 0x89, 204, 0xFA },
+	{ 5098, 35, 81, 0x4D, 204, 0xFA },
+	{ 5162, 35, 82, 0x06, 204, 0xFA },
+	{ 5218, 35, 82, 0xC1, 204, 0xFA },
+	{ 5282, 35, 83, 0xA5, 205, 0xFA },
+	{ 5339, 35, 84, 0x59, 205, 0xFA },
+	{ 5399, 35, 85, 0x2C, 205, 0xFA },
+	{ 5460, 35, 85, 0xFF, 205, 0xFA },
+	{ 5521, 35, 86, 0xD1, 205, 0xFA },
+	{ 5581, 35, 87, 0x8B, 206, 0xFA },
+	{ 5641, 35, 88, 0x71, 206, 0xFA },
+};
+
+#define TRACE_ROWS(trace) (sizeof(trace) / sizeof(*(trace)))
+
+static const BatteryTraceRow *s_Row;
+static u32 s_Failures;
+
+#define CHECK(cond) do { if (!(cond)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); s_Failures++; } } while (0)
+
+void RecursiveLock_Lock(RecursiveLock *lock) { (void)lock; }
+void RecursiveLock_Unlock(RecursiveLock *lock) { (void)lock; }
+
+Result svcSignalEvent(Handle handle) { (void)handle; return 0; }
+
+/* half a second in, so TICKS_TO_S doesn't round down to the second before */
+s64 svcGetSystemTick(void) { return (s64)s_Row->seconds * SYSCLOCK_ARM11 + SYSCLOCK_ARM11 / 2; }
+
+void ERRF_ThrowResultNoRet(Result failure)
+{
+	printf("thrown 0x%08lX\n", (unsigned long)failure);
+	exit(1);
+}
+
+/* temperature, percentage (integer), percentage (fraction), voltage, unused, power status */
+Result mcuReadRegisterBuffer8(u8 regid, void *buf, u32 size)
+{
+	u8 *data = buf;
+
+	if (regid != MCUREG_BATTERY_PCB_TEMPERATURE || size != 6)
+		return -1;
+
+	data[0] = s_Row->temperature;
+	data[1] = s_Row->percentage;
+	data[2] = s_Row->fraction;
+	data[3] = s_Row->voltage;
+	data[4] = 0;
+	data[5] = s_Row->power_status;
+	return 0;
+}
+
+Result mcuReadRegisterBuffer8_l(u8 regid, void *buf, u32 size) { return mcuReadRegisterBuffer8(regid, buf, size); }
+
+void mcuPublishBatterySample(const MCU_BatterySample *sample, u8 power_status) { (void)sample; (void)power_status; }
+
+static void feed(const BatteryTraceRow *rows, u32 count)
+{
+	for (u32 i = 0; i < count; i++) {
+		s_Row = &rows[i];
+		CHECK(R_SUCCEEDED(mcuSampleBattery(LOCK)));
+	}
+}
+
+static void testTraces()
+{
+	MCU_BatteryEstimate estimate;
+
+	/* nothing to go on from a single sample */
+	feed(s_DischargeTrace, 1);
+	mcuGetBatteryEstimate(&estimate);
+	CHECK(!estimate.charging);
+	CHECK(estimate.minutes == BATTERY_ESTIMATE_UNKNOWN);
+	CHECK(estimate.confidence == 0);
+
+	/* 58% left at 0.42% a minute is about 138 minutes, the recalibration step must not pull it in */
+	feed(s_DischargeTrace + 1, TRACE_ROWS(s_DischargeTrace) - 1);
+	mcuGetBatteryEstimate(&estimate);
+	CHECK(!estimate.charging);
+	CHECK(estimate.rate < -(s32)(0.36 * 65536) && estimate.rate > -(s32)(0.48 * 65536));
+	CHECK(estimate.minutes >= 120 && estimate.minutes <= 160);
+	CHECK(estimate.confidence >= 80);
+
+	/* plugging in throws the discharge trend away */
+	feed(s_ChargeTrace, 1);
+	mcuGetBatteryEstimate(&estimate);
+	CHECK(estimate.charging);
+	CHECK(estimate.minutes == BATTERY_ESTIMATE_UNKNOWN);
+	CHECK(estimate.confidence == 0);
+
+	/* 11.5% to go at 0.8% a minute is about 14 minutes */
+	feed(s_ChargeTrace + 1, TRACE_ROWS(s_ChargeTrace) - 1);
+	mcuGetBatteryEstimate(&estimate);
+	CHECK(estimate.charging);
+	CHECK(estimate.rate > (s32)(0.7 * 65536) && estimate.rate < (s32)(0.9 * 65536));
+	CHECK(estimate.minutes >= 11 && estimate.minutes <= 18);
+	CHECK(estimate.confidence >= 80);
+}
+
+static double nowNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main()
+{
+	testTraces();
+
+	if (s_Failures) {
+		printf("%lu failure(s)\n", (unsigned long)s_Failures);
+		return 1;
+	}
+
+	/* the discharge trace over and over, an hour later each time round */
+	const u32 iterations = 1000000;
+	volatile s32 sink = 0;
+	MCU_BatterySample sample = { 0, 0, 0, 0 };
+
+	resetBatteryEstimator(&sample);
+
+	double start = nowNs();
+	for (u32 i = 0; i < iterations; i++) {
+		const BatteryTraceRow *row = &s_DischargeTrace[i % TRACE_ROWS(s_DischargeTrace)];
+
+		sample.seconds = row->seconds + i / TRACE_ROWS(s_DischargeTrace) * 3600;
+		sample.percentage = (u16)(row->percentage << 8 | row->fraction);
+		sample.voltage = row->voltage;
+		updateBatteryEstimator(&sample);
+		sink += s_BatteryEstimator.rate;
+	}
+	double estimator = (nowNs() - start) / iterations;
+
+	BatteryTraceRow row;
+
+	s_Row = &row;
+	start = nowNs();
+	for (u32 i = 0; i < iterations; i++) {
+		row = s_DischargeTrace[i % TRACE_ROWS(s_DischargeTrace)];
+		row.seconds += i / TRACE_ROWS(s_DischargeTrace) * 3600;
+		mcuSampleBattery(LOCK);
+	}
+	double sampler = (nowNs() - start) / iterations;
+
+	printf("estimator update %.1f ns, full sample %.1f ns per sample\n", estimator, sampler);
+	printf("ok\n");
+	return 0;
+}
@@ -0,0 +1,146 @@
+/*
+	Host benchmark for the pedometer statistics kernels in source/mcu/pedometer.c,
+	against a plain per-hour loop. The native build measures the scalar fallback;
+	an ARMv6 build (e.g. CC=arm-linux-gnueabihf-gcc ARCH=-march=armv6, run under
+	qemu-arm) measures the SIMD32 kernels. Both are checked against the plain
+	loop first. Build and run with `make -C tests`.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../source/mcu/pedometer.c"
+
+RecursiveLock g_I2CLock;
+Handle g_WorkerEvent;
+
+static u32 s_Failures;
+
+#define CHECK(cond) do { if (!(cond)) { printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); s_Failures++; } } while (0)
+
+void RecursiveLock_Lock(RecursiveLock *lock) { (void)lock; }
+void RecursiveLock_Unlock(RecursiveLock *lock) { (void)lock; }
+
+Result svcCreateEvent(Handle *event, ResetType reset_type) { (void)reset_type; *event = 0x1234; return 0; }
+Result svcSignalEvent(Handle handle) { (void)handle; return 0; }
+Result svcCloseHandle(Handle handle) { (void)handle; return 0; }
+
+void ERRF_ThrowResultNoRet(Result failure)
+{
+	printf("thrown 0x%08lX\n", (unsigned long)failure);
+	exit(1);
+}
+
+/* the statistics only ever see the cache, the bus isn't needed */
+Result mcuReadRegisterBuffer(u8 regid, void *data, u32 size) { (void)regid; (void)data; (void)size; return -1; }
+Result mcuReadPedometerStepCount(u32 *out_value, bool lock) { (void)lock; *out_value = 0; return 0; }
+Result mcuReadAccelerometerData(MCU_AccelerometerData *out_data, bool lock) { (void)out_data; (void)lock; return -1; }
+
+/* the same statistics one hour at a time */
+static void referenceStats(MCU_PedometerStats *stats)
+{
+	u16 hours[PEDOMETER_HOURS];
+
+	for (u32 i = 0; i < PEDOMETER_HOURS; i++)
+		hours[i] = s_Pedometer.steps[pedometerSlot(s_Pedometer.hour - i)];
+
+	_memset(stats, 0, sizeof(MCU_PedometerStats));
+	stats->generation = s_Pedometer.generation;
+
+	for (u32 i = 0; i < PEDOMETER_HOURS; i++) {
+		u32 day = i <= s_Pedometer.time.hour ? 0 : (i - s_Pedometer.time.hour - 1) / 24 + 1;
+
+		stats->week_total += hours[i];
+
+		if (day < 7)
+			stats->day_totals[day] += hours[i];
+
+		if (hours[i] > stats->peak_steps) {
+			stats->peak_steps = hours[i];
+			stats->peak_hours_ago = (u8)i;
+		}
+
+		if (hours[i])
+			stats->active_hours++;
+	}
+}
+
+static u32 s_Rng = 1;
+
+static u32 nextRandom()
+{
+	s_Rng = s_Rng * 1103515245 + 12345;
+	return s_Rng >> 8;
+}
+
+static void fillSteps(u32 hour_of_day)
+{
+	s_Pedometer.hour = 1000 * 24 + hour_of_day;
+	s_Pedometer.time.hour = (u8)hour_of_day;
+	s_Pedometer.generation++;
+
+	/* mostly idle hours, some busy ones, and counts above 0x7FFF that a signed kernel would get wrong */
+	for (u32 i = 0; i < PEDOMETER_HOURS; i++) {
+		u32 r = nextRandom();
+		s_Pedometer.steps[i] = (u16)((r & 3) == 0 ? 0 : (r & 7) == 1 ? 0x8000 + (r >> 12 & 0x7FFF) : r >> 12 & 0xFFF);
+	}
+}
+
+static double nowNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main()
+{
+	MCU_PedometerStats expected;
+
+	for (u32 round = 0; round < 2000; round++) {
+		fillSteps(round % 24);
+		computePedometerStats();
+		referenceStats(&expected);
+
+		CHECK(s_PedometerStats.week_total == expected.week_total);
+		CHECK(s_PedometerStats.peak_steps == expected.peak_steps);
+		CHECK(s_PedometerStats.peak_hours_ago == expected.peak_hours_ago);
+		CHECK(s_PedometerStats.active_hours == expected.active_hours);
+
+		for (u32 day = 0; day < 7; day++)
+			CHECK(s_PedometerStats.day_totals[day] == expected.day_totals[day]);
+	}
+
+	if (s_Failures) {
+		printf("%lu failure(s)\n", (unsigned long)s_Failures);
+		return 1;
+	}
+
+	const u32 iterations = 200000;
+	volatile u32 sink = 0;
+
+	fillSteps(13);
+
+	double start = nowNs();
+	for (u32 i = 0; i < iterations; i++) {
+		computePedometerStats();
+		sink += s_PedometerStats.week_total;
+	}
+	double kernels = (nowNs() - start) / iterations;
+
+	start = nowNs();
+	for (u32 i = 0; i < iterations; i++) {
+		referenceStats(&expected);
+		sink += expected.week_total;
+	}
+	double reference = (nowNs() - start) / iterations;
+
+#if defined(__ARM_FEATURE_SIMD32)
+	const char *kind = "simd32";
+#else
+	const char *kind = "scalar";
+#endif
+
+	printf("%s kernels %.1f ns, per-hour loop %.1f ns per computation\n", kind, kernels, reference);
+	return 0;
+}
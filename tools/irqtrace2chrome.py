@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+"""
+Turns an IRQ trace dump (the buffer filled by mcu::HWC 0x0014, an array of
+MCU_IrqTraceRecord) into a Chrome trace event file for chrome://tracing or
+Perfetto. Each wakeup becomes three slices on the IRQ thread: the lock wait,
+the I2C read and the dispatch.
+
+usage: irqtrace2chrome.py dump.bin [trace.json]
+"""
+
+import json
+import struct
+import sys
+
+SYSCLOCK_ARM11 = 268111856
+
+# see include/mcu/trace.h
+RECORD = struct.Struct("<qIIII")
+
+def ticks_to_us(ticks):
+	return ticks * 1000000 / SYSCLOCK_ARM11
+
+def convert(data):
+	events = []
+	usable = len(data) - len(data) % RECORD.size
+	records = [RECORD.unpack_from(data, offset) for offset in range(0, usable, RECORD.size)]
+	records = [r for r in records if r[0]]
+	
+	if not records:
+		return events
+	
+	base = records[0][0]
+	
+	for wake_tick, lock_wait, read_done, dispatch_done, irqs in records:
+		start = wake_tick - base
+		args = { "irqs": "0x%08X" % irqs }
+		
+		for name, begin, end in (("lock wait", 0, lock_wait), ("i2c read", lock_wait, read_done), ("dispatch", read_done, dispatch_done)):
+			events.append({
+				"name": name,
+				"cat": "irq",
+				"ph": "X",
+				"pid": 1,
+				"tid": 1,
+				"ts": ticks_to_us(start + begin),
+				"dur": ticks_to_us(max(end - begin, 0)),
+				"args": args,
+			})
+	
+	return events
+
+def main():
+	if len(sys.argv) < 2:
+		sys.exit(__doc__.strip())
+	
+	with open(sys.argv[1], "rb") as f:
+		events = convert(f.read())
+	
+	trace = json.dumps({ "traceEvents": events, "displayTimeUnit": "ns" }, indent=1)
+	
+	if len(sys.argv) > 2:
+		with open(sys.argv[2], "w") as f:
+			f.write(trace)
+	else:
+		print(trace)
+
+if __name__ == "__main__":
+	main()